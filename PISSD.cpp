@@ -12,6 +12,20 @@
 #include <string>
 #include <mutex>
 #include <vector>
+#include <list>
+#include <memory>
+#include <atomic>
+#include <unordered_map>
+#include <deque>
+#include <thread>
+#include <future>
+#include <functional>
+#include <condition_variable>
+#include <shared_mutex>
+#include <map>
+#include <set>
+#include <chrono>
+#include <cstdio>
 #include <boost/filesystem.hpp>
 #include <boost/foreach.hpp>
 
@@ -32,75 +46,215 @@
 
 #endif
 
+#ifdef __linux__
+
+#include <sys/stat.h>
+#include <sys/utsname.h>
+#include <pwd.h>
+
+#endif
+
+#ifndef WIN32
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+
+#endif
+
+#ifdef PISSD_IO_URING
+
+#include <liburing.h>
+
+#endif
+
 #include <cryptopp/modes.h>
 #include <cryptopp/aes.h>
 #include <cryptopp/filters.h>
 #include <cryptopp/osrng.h>
-#include <cryptopp/base64.h>
 #include <cryptopp/pwdbased.h>
 #include <cryptopp/hex.h>
-#include <cryptopp/eax.h>
+#include <cryptopp/gcm.h>
+#include <cryptopp/sha.h>
+#include <cryptopp/hkdf.h>
+#include <cryptopp/crc.h>
 
 #include "PISSD.hpp"
 
 
 #define SALTSIZE 32
+#define MASTERKEY_ITERATIONS 10000
+#define RECORD_MAGIC "PSD"
+#define RECORD_HEADER_SIZE 4
+#define RECORD_V3 3
+#define VALUE_STRING 1
+#define VALUE_DOUBLE 2
+#define VALUE_FLOAT 3
+#define VALUE_INT64 4
+#define VALUE_BOOL 5
+#define NONCESIZE 12
+#define TAGSIZE 16
+#define KEYCACHE_DEFAULT_SIZE 256
+#define CIPHERPOOL_SIZE 8
+#define SALTPOOL_SIZE 4096
+#define WORKERPOOL_SIZE 4
+#define LOCK_STRIPES 64
+#define MANIFEST_MAGIC "PSM"
+#define MANIFEST_JOURNAL_MAGIC "PSJ"
+#define MANIFEST_VERSION 1
+#define MANIFEST_HEADER_SIZE 12
+#define MANIFEST_FILE ".manifest"
+#define MANIFEST_JOURNAL_FILE ".manifest.log"
+#define MANIFEST_JOURNAL_LIMIT 4096
+#define MANIFEST_ADD_KEY 'K'
+#define MANIFEST_REMOVE_KEY 'k'
+#define MANIFEST_ADD_MODULE 'M'
+#define MANIFEST_REMOVE_MODULE 'm'
+#define SEGMENT_DIRECTORY ".segments"
+#define SEGMENT_MARKER "engine"
+#define SEGMENT_MAX_SIZE (64 * 1024 * 1024)
+#define COMPACTION_CHUNK_SIZE (1024 * 1024)
+#define COMPACTION_BATCH_SIZE 1024
+#define COMPACTION_INTERVAL 1
+#define SYNCGROUP_BATCH_SIZE 64
+#define SYNCGROUP_SYNCFS_PATHS 32
+#define URING_ENTRIES 32
+#define URING_SLOT 0
+#define WRITE_QUORUM_DEFAULT 2
+#define FANOUT_BACKLOG 1024
+#define READERPOOL_SIZE 8
+#define HEDGE_DEADLINE 10000
+#define HEDGE_PROBE_INTERVAL 64
+#define LATENCY_WEIGHT 8
+#define SEGMENT_PUT 'P'
+#define SEGMENT_DELETE 'D'
+#define SEGMENT_REMOVE_MODULE 'M'
 
 /**
- * Hash a string
- * @param aString is string to be hashed
- * @return hash as string
+ * Keyed cipher contexts of one dataKey, they are wiped on destruction
  */
-std::string SHA512HashString(std::string const aString)
+struct CipherContexts
 {
-    std::string digest;
-    CryptoPP::SHA512 hash;
-
-    CryptoPP::StringSource foo(aString, true,
-                               new CryptoPP::HashFilter(hash,
-                                                        new CryptoPP::Base64Encoder(new CryptoPP::StringSink(digest))));
+    CryptoPP::GCM<CryptoPP::AES>::Encryption gcmEncryption;
+    CryptoPP::GCM<CryptoPP::AES>::Decryption gcmDecryption;
 
-    return digest;
-}
+    CipherContexts(const CryptoPP::SecByteBlock &key, const CryptoPP::SecByteBlock &iv)
+    {
+        // Nonce of every record is set by EncryptAndAuthenticate and DecryptAndVerify
+        gcmEncryption.SetKeyWithIV(key, key.size(), iv, NONCESIZE);
+        gcmDecryption.SetKeyWithIV(key, key.size(), iv, NONCESIZE);
+    }
+};
 
 /**
- * Remove .jkl extension
- * @param fileName is string to be striped
- * @return string without extension
+ * Key and iv of one dataKey with pool of its idle cipher contexts, all of them are wiped on destruction.
+ * Contexts are reused by every record of the key, each operation borrows one by CipherLease.
+ * Material of records without header is derived on first use and kept with it.
  */
-std::string stripExtension(std::string fileName)
+struct KeyMaterial
 {
-    fileName.erase(0, 1);
-    fileName.erase(fileName.end()-4, fileName.end());
-    return fileName;
-}
+    CryptoPP::SecByteBlock key;
+    CryptoPP::SecByteBlock iv;
+    std::mutex poolMutex;
+    std::vector<std::unique_ptr<CipherContexts>> idleContexts;
+    std::once_flag legacyOnce;
+    std::unique_ptr<KeyMaterial> legacy;
+
+    KeyMaterial(const CryptoPP::byte keyData[], const CryptoPP::byte ivData[])
+            : key(keyData, CryptoPP::AES::MAX_KEYLENGTH), iv(ivData, CryptoPP::AES::MAX_BLOCKSIZE)
+    {
+    }
+};
 
 /**
- * Check if module is in a path
- * @param filePath to be checked
- * @param module to be checked
- * @return true if module is in a path
+ * Cipher contexts borrowed from key material for one operation, so threads using the same key do not
+ * wait for each other. Idle contexts are returned to the pool, new ones are keyed only when it is empty.
  */
-bool checkPath(std::string filePath, std::string module)
+class CipherLease
 {
-    std::string delimiter = "/";
-    size_t pos = 0;
-    std::string token;
-    while ((pos = filePath.find(delimiter)) != std::string::npos)
+private:
+    KeyMaterial &material;
+    std::unique_ptr<CipherContexts> contexts;
+
+public:
+    explicit CipherLease(KeyMaterial &material) : material(material)
     {
-        token = filePath.substr(0, pos);
-        if (token == module)
         {
-            return true;
+            std::lock_guard<std::mutex> lock(material.poolMutex);
+            if (!material.idleContexts.empty())
+            {
+                contexts = std::move(material.idleContexts.back());
+                material.idleContexts.pop_back();
+            }
+        }
+        if (!contexts)
+        {
+            contexts.reset(new CipherContexts(material.key, material.iv));
         }
-        filePath.erase(0, pos + delimiter.length());
     }
-    if (filePath == module)
+
+    ~CipherLease()
     {
-        return true;
+        std::lock_guard<std::mutex> lock(material.poolMutex);
+        if (material.idleContexts.size() < CIPHERPOOL_SIZE)
+        {
+            material.idleContexts.push_back(std::move(contexts));
+        }
     }
 
-    return false;
+    CipherContexts *operator->()
+    {
+        return contexts.get();
+    }
+};
+
+/**
+ * Hash a string, digest is Base64 encoded with line break after 72 characters and at the end
+ * @param aString is string to be hashed
+ * @return hash as string
+ */
+std::string SHA512HashString(std::string const &aString)
+{
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    static thread_local CryptoPP::SHA512 hash;
+
+    CryptoPP::byte digest[CryptoPP::SHA512::DIGESTSIZE];
+    hash.CalculateDigest(digest, (const CryptoPP::byte *) aString.data(), aString.size());
+
+    std::string encoded;
+    for (size_t i = 0; i < sizeof(digest); i += 3)
+    {
+        uint32_t group = digest[i] << 16;
+        if (i + 1 < sizeof(digest))
+        {
+            group |= digest[i + 1] << 8;
+        }
+        if (i + 2 < sizeof(digest))
+        {
+            group |= digest[i + 2];
+        }
+
+        encoded += alphabet[(group >> 18) & 0x3f];
+        encoded += alphabet[(group >> 12) & 0x3f];
+        encoded += i + 1 < sizeof(digest) ? alphabet[(group >> 6) & 0x3f] : '=';
+        encoded += i + 2 < sizeof(digest) ? alphabet[group & 0x3f] : '=';
+    }
+    encoded.insert(72, 1, '\n');
+    encoded += '\n';
+
+    return encoded;
+}
+
+/**
+ * Remove .jkl extension
+ * @param fileName is string to be striped
+ * @return string without extension
+ */
+std::string stripExtension(std::string fileName)
+{
+    fileName.erase(0, 1);
+    fileName.erase(fileName.end()-4, fileName.end());
+    return fileName;
 }
 
 /**
@@ -118,10 +272,48 @@ std::string getUsername()
 #ifdef __APPLE__
     return getlogin();
 #endif
+#ifdef __linux__
+    struct passwd *account = getpwuid(geteuid());
+    if (account != nullptr && account->pw_name != nullptr)
+    {
+        return account->pw_name;
+    }
+
+    const char *user = getenv("USER");
+    return user != nullptr ? user : "";
+#endif
+}
+
+#ifdef __linux__
+
+/**
+ * Find base directory defined by XDG Base Directory Specification
+ * @param variable is name of environment variable overriding the directory
+ * @param fallback is path of directory relative to home used when variable is not set
+ * @return path to directory
+ */
+std::string getXdgDir(const char *variable, const std::string &fallback)
+{
+    const char *value = getenv(variable);
+    if (value != nullptr && value[0] == '/')
+    {
+        return value;
+    }
+
+    const char *home = getenv("HOME");
+    if (home == nullptr || home[0] == '\0')
+    {
+        struct passwd *account = getpwuid(geteuid());
+        home = account != nullptr ? account->pw_dir : "";
+    }
+
+    return home + fallback;
 }
 
+#endif
+
 /**
- * Find and create paths for PISSD folders
+ * Find paths for PISSD folders
  * @param pathNames is array of string contains path to folders
  */
 void getDirPath(std::string pathNames[])
@@ -138,8 +330,6 @@ void getDirPath(std::string pathNames[])
         std::string path = szPath;
         path += "/PISSD";
         pathNames[0] = path;
-        CreateDirectory(path.c_str(), NULL);
-        SetFileAttributes(path.c_str(), FILE_ATTRIBUTE_HIDDEN);
     }
 
     if (SUCCEEDED(SHGetFolderPath(NULL,
@@ -151,8 +341,6 @@ void getDirPath(std::string pathNames[])
         std::string path = szPath;
         path += "/PISSD";
         pathNames[1] = path;
-        CreateDirectory(path.c_str(), NULL);
-        SetFileAttributes(path.c_str(), FILE_ATTRIBUTE_HIDDEN);
     }
 
     if (SUCCEEDED(SHGetFolderPath(NULL,
@@ -164,40 +352,79 @@ void getDirPath(std::string pathNames[])
         std::string path = szPath;
         path += "/PISSD";
         pathNames[2] = path;
-        CreateDirectory(path.c_str(), NULL);
-        SetFileAttributes(path.c_str(), FILE_ATTRIBUTE_HIDDEN);
     }
 #endif
 #ifdef __APPLE__
-    struct stat st = {0};
-
     std::string homePath = getenv("HOME");
 
-    std::string configPath = homePath + "/.config/.PISSD";
-    pathNames[0] = configPath;
+    pathNames[0] = homePath + "/.config/.PISSD";
+    pathNames[1] = homePath + "/Documents/.PISSD";
+    pathNames[2] = homePath + "/Library/.PISSD";
+#endif
+#ifdef __linux__
+    pathNames[0] = getXdgDir("XDG_DATA_HOME", "/.local/share") + "/PISSD";
+    pathNames[1] = getXdgDir("XDG_CONFIG_HOME", "/.config") + "/PISSD";
+    pathNames[2] = getXdgDir("XDG_STATE_HOME", "/.local/state") + "/PISSD";
+#endif
+}
 
-    std::string documentsPath = homePath + "/Documents/.PISSD";
-    pathNames[1] = documentsPath;
+#ifdef __linux__
 
-    std::string libraryPath = homePath + "/Library/.PISSD";
-    pathNames[2] = libraryPath;
+/**
+ * Create folder with all its parents, the folder itself is accessible only by its owner
+ * @param path is path to folder
+ */
+void createLinuxDir(const std::string &path)
+{
+    boost::system::error_code error;
+    boost::filesystem::create_directories(path, error);
+    chmod(path.c_str(), 0700);
+}
 
+#endif
 
-    if (stat(configPath.c_str(), &st) == -1)
+/**
+ * Resolve path to PISSD folder to canonical form, so different spellings of the same folder compare equal
+ * @param path is path to folder, it does not have to exist
+ * @return canonical path without trailing separator
+ */
+std::string canonicalRoot(std::string path)
+{
+    while (path.size() > 1 && (path.back() == '/' || path.back() == '\\'))
     {
-        mkpath_np(configPath.c_str(), 0700);
+        path.pop_back();
     }
 
-    if (stat(documentsPath.c_str(), &st) == -1)
-    {
-        mkpath_np(documentsPath.c_str(), 0700);
-    }
+    boost::system::error_code error;
+    boost::filesystem::path canonical = boost::filesystem::weakly_canonical(path, error);
+
+    return error ? path : canonical.string();
+}
 
-    if (stat(libraryPath.c_str(), &st) == -1)
+/**
+ * Create PISSD folders if they do not exist
+ * @param pathNames is array of string contains path to folders
+ */
+void createDirPath(const std::string pathNames[])
+{
+    for (int i = 0; i < 3; ++i)
     {
-        mkpath_np(libraryPath.c_str(), 0700);
-    }
+#ifdef WIN32
+        CreateDirectory(pathNames[i].c_str(), NULL);
+        SetFileAttributes(pathNames[i].c_str(), FILE_ATTRIBUTE_HIDDEN);
+#endif
+#ifdef __APPLE__
+        struct stat st = {0};
+
+        if (stat(pathNames[i].c_str(), &st) == -1)
+        {
+            mkpath_np(pathNames[i].c_str(), 0700);
+        }
+#endif
+#ifdef __linux__
+        createLinuxDir(pathNames[i]);
 #endif
+    }
 }
 
 /**
@@ -223,623 +450,4707 @@ void addModuleToPath(std::string module, std::string paths[])
 }
 
 /**
- * Saved data to file
- * @param fileName is string
- * @param data is string that will be saved
+ * Flush file or folder to disk
+ * @param path is path to file or folder
+ * @param dataOnly is true if metadata not needed to read the data may stay in cache
+ * @return false if flush fails
  */
-void createFile(std::string fileName, std::string data)
+bool syncPath(const std::string &path, bool dataOnly)
 {
-    std::string pathNames[3];
-    getDirPath(pathNames);
-
-    for (int i = 0; i < 3; ++i)
-    {
-        pathNames[i].append("/." + fileName + ".jkl");
 #ifdef WIN32
-        DeleteFile(pathNames[i].c_str());
-#endif
-        std::ofstream outFile(pathNames[i], std::ios::out | std::ios::binary);
-        outFile << data;
-        outFile.close();
+    HANDLE handle = CreateFile(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING,
+                               FILE_FLAG_BACKUP_SEMANTICS, NULL);
+    if (handle == INVALID_HANDLE_VALUE)
+    {
+        // Folders cannot be flushed on Windows, their entries are journaled by NTFS
+        return boost::filesystem::is_directory(path);
     }
+    bool flushed = FlushFileBuffers(handle) != 0;
+    CloseHandle(handle);
 
-#ifdef WIN32
-
-    for (int i = 0; i < 3; ++i)
+    return flushed;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
     {
-        SetFileAttributes(pathNames[i].c_str(), FILE_ATTRIBUTE_HIDDEN);
+        return false;
     }
+#ifdef __APPLE__
+    bool flushed = fcntl(fd, F_FULLFSYNC) == 0 || fsync(fd) == 0;
+#else
+    bool flushed = (dataOnly ? fdatasync(fd) : fsync(fd)) == 0;
+#endif
+    close(fd);
+
+    return flushed;
 #endif
 }
 
 /**
- * Save data to file in module
- * @param module where file will be stored
- * @param fileName is string
- * @param data is string that will be saved
+ * Lock files of PISSD folders held by this process with number of their users, so state of folders that
+ * is being destroyed and its successor share the lock
  */
-void createFile(std::string module, std::string fileName, std::string data)
+struct FolderLocks
 {
-    std::string pathNames[3];
-    getDirPath(pathNames);
-    addModuleToPath(module, pathNames);
-
-    for (int i = 0; i < 3; ++i)
-    {
-        pathNames[i].append("/." + fileName + ".jkl");
+    std::mutex locksMutex;
 #ifdef WIN32
-        DeleteFile(pathNames[i].c_str());
+    std::map<std::string, std::pair<HANDLE, size_t>> held;
+#else
+    std::map<std::string, std::pair<int, size_t>> held;
 #endif
-        std::ofstream outFile(pathNames[i], std::ios::out | std::ios::binary);
-        outFile << data;
-        outFile.close();
-    }
 
-#ifdef WIN32
-
-    for (int i = 0; i < 3; ++i)
+    static FolderLocks &instance()
     {
-        SetFileAttributes(pathNames[i].c_str(), FILE_ATTRIBUTE_HIDDEN);
+        static FolderLocks locks;
+
+        return locks;
     }
-#endif
-}
+};
 
 /**
- * Return UUID of device
- * @return UUID as string
+ * Lock PISSD folders against other processes. Lock file lies next to each folder, so it survives removal
+ * of the folder by deleteAllData.
+ * @param rootPaths is array of canonical paths to PISSD folders
+ * @return false if some folder is used by another process
  */
-std::string getUUID()
+bool lockFolders(const std::string rootPaths[])
 {
-#ifdef WIN32
-    HW_PROFILE_INFO HwProfInfo;
-    if (!GetCurrentHwProfile(&HwProfInfo))
-    {
-        _tprintf(TEXT("GetCurrentHwProfile failed with error %lx\n"),
-                 GetLastError());
-    } else
+    FolderLocks &locks = FolderLocks::instance();
+    std::lock_guard<std::mutex> lock(locks.locksMutex);
+    int taken = 0;
+    for (; taken < 3; ++taken)
     {
-        return HwProfInfo.szHwProfileGuid;
-    }
-#endif
-
-#ifdef __APPLE__
-    struct timespec ts = { .tv_sec = 5, .tv_nsec = 0 };
-    uuid_t uuid = {};
+        auto found = locks.held.find(rootPaths[taken]);
+        if (found != locks.held.end())
+        {
+            found->second.second++;
+            continue;
+        }
 
-    if (gethostuuid(uuid, &ts) == -1) {
-        switch (errno) {
-            case EFAULT:
-                fputs("Failed to get system UUID: unknown error", stderr);
-                return NULL;
-            case EWOULDBLOCK:
-                fputs("Failed to get system UUID: timeout expired", stderr);
-                return NULL;
+        std::string path = rootPaths[taken] + ".lock";
+        boost::system::error_code error;
+        boost::filesystem::create_directories(boost::filesystem::path(path).parent_path(), error);
+#ifdef WIN32
+        // File opened without sharing stays exclusive until it is closed
+        HANDLE handle = CreateFile(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_ALWAYS,
+                                   FILE_ATTRIBUTE_HIDDEN, NULL);
+        if (handle == INVALID_HANDLE_VALUE)
+        {
+            break;
+        }
+        locks.held[rootPaths[taken]] = std::make_pair(handle, (size_t) 1);
+#else
+        int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+        if (fd >= 0 && flock(fd, LOCK_EX | LOCK_NB) != 0)
+        {
+            close(fd);
+            fd = -1;
+        }
+        if (fd < 0)
+        {
+            break;
         }
+        locks.held[rootPaths[taken]] = std::make_pair(fd, (size_t) 1);
+#endif
+    }
+    if (taken == 3)
+    {
+        return true;
     }
 
-    uuid_string_t uuid_string;
-    uuid_unparse_upper(uuid, uuid_string);
-
-    return uuid_string;
+    for (int i = 0; i < taken; ++i)
+    {
+        auto found = locks.held.find(rootPaths[i]);
+        if (--found->second.second == 0)
+        {
+#ifdef WIN32
+            CloseHandle(found->second.first);
+#else
+            close(found->second.first);
 #endif
+            locks.held.erase(found);
+        }
+    }
 
-    return NULL;
+    return false;
 }
 
 /**
- * Compare cipher text
- * @param data is array containing data
- * @return number of matches as int
+ * Release locks taken by lockFolders, folder is unlocked once its last user releases it
+ * @param rootPaths is array of canonical paths to PISSD folders
  */
-int compareCiphertext(std::string data[])
+void unlockFolders(const std::string rootPaths[])
 {
-    int equalCounter = 0;
-
+    FolderLocks &locks = FolderLocks::instance();
+    std::lock_guard<std::mutex> lock(locks.locksMutex);
     for (int i = 0; i < 3; ++i)
     {
-        for (int j = i; j < 3; ++j)
+        auto found = locks.held.find(rootPaths[i]);
+        if (found != locks.held.end() && --found->second.second == 0)
         {
-            if (data[i] == data[j])
-            {
-                equalCounter++;
-            }
-
-            if (i == j)
-            {
-                equalCounter--;
-            }
+#ifdef WIN32
+            CloseHandle(found->second.first);
+#else
+            close(found->second.first);
+#endif
+            locks.held.erase(found);
         }
     }
-
-    return equalCounter;
 }
 
-/**
- * Open files and puts their content to data
- * @param data array where data will be stored
- * @param fileName is string
- * @return non-zero value if there was a problem
- */
-int loadFile(std::string data[], std::string fileName)
+namespace PISSD
 {
-    std::string dirPath[3];
-    int emptyFileCounter = 0;
-
-    getDirPath(dirPath);
-
-    for (int i = 0; i < 3; ++i)
+    /**
+     * File or folder that has to reach disk, root is PISSD folder holding it
+     */
+    struct SyncTarget
     {
+        std::string root;
+        std::string path;
+        bool dataOnly;
+    };
 
-        dirPath[i].append("/." + fileName + ".jkl");
-        std::ifstream infile(dirPath[i], std::ifstream::binary);
-        if (infile.is_open())
+    /**
+     * Sync requests of concurrent writers are collected into groups. The first writer of a group leads it,
+     * it waits for more writers up to window or batch size and then syncs every PISSD folder once for all
+     * of them. Writers arriving meanwhile form the next group.
+     */
+    class SyncGroup
+    {
+    private:
+        struct Batch
         {
-            std::string str((std::istreambuf_iterator<char>(infile)),
-                            std::istreambuf_iterator<char>());
-            infile.close();
+            std::map<std::string, std::map<std::string, bool>> roots;
+            size_t writers = 0;
+            bool done = false;
+            bool synced = true;
+        };
+
+        std::mutex groupMutex;
+        std::condition_variable groupCondition;
+        std::shared_ptr<Batch> current;
+        bool leading;
+        size_t batchSize;
+        std::chrono::microseconds window;
+
+        /**
+         * Flush everything batch needs from one PISSD folder
+         * @param root is path to PISSD folder
+         * @param paths are files and folders to flush, mapped to true if only their data is needed
+         * @return false if flush fails
+         */
+        static bool syncRoot(const std::string &root, const std::map<std::string, bool> &paths)
+        {
+#ifdef __linux__
+            // One syncfs covers large group, but it flushes every dirty file of the filesystem, so small
+            // groups flush their own paths
+            if (paths.size() >= SYNCGROUP_SYNCFS_PATHS && syncfsReportsErrors())
+            {
+                int fd = ::open(root.c_str(), O_RDONLY);
+                if (fd >= 0)
+                {
+                    bool synced = syncfs(fd) == 0;
+                    close(fd);
+                    return synced;
+                }
+            }
+#endif
+            bool synced = true;
+            for (auto &path : paths)
+            {
+                synced = syncPath(path.first, path.second) && synced;
+            }
 
-            data[i] = str;
+            return synced;
         }
 
-        if (data[i].empty())
+#ifdef __linux__
+        /**
+         * Check if syncfs reports failed writeback, kernels before 5.8 return success regardless
+         * @return true if kernel is 5.8 or newer
+         */
+        static bool syncfsReportsErrors()
         {
-            emptyFileCounter++;
-        }
-    }
-
-    if (emptyFileCounter == 3)
-    {
-        return 2;
-    }
-
-    if (emptyFileCounter == 2)
-    {
-        return 1;
-    }
-
-    return 0;
-}
+            static const bool reports = []
+            {
+                struct utsname name;
+                int major = 0, minor = 0;
+                if (uname(&name) != 0 || sscanf(name.release, "%d.%d", &major, &minor) != 2)
+                {
+                    return false;
+                }
 
-/**
- * Open files from module and puts their content to data
- * @param module where file should exists
- * @param data array where data will be stored
- * @param fileName is string
- * @return non-zero value if there was a problem
- */
-int loadFile(std::string module, std::string data[], std::string fileName)
-{
-    std::string dirPath[3];
-    int emptyFileCounter = 0;
+                return major > 5 || (major == 5 && minor >= 8);
+            }();
 
-    getDirPath(dirPath);
-    addModuleToPath(module, dirPath);
+            return reports;
+        }
+#endif
 
-    for (int i = 0; i < 3; ++i)
-    {
+    public:
+        std::atomic<uint64_t> groups;
+        std::atomic<uint64_t> requests;
 
-        dirPath[i].append("/." + fileName + ".jkl");
-        std::ifstream infile(dirPath[i], std::ifstream::binary);
-        if (infile.is_open())
+        SyncGroup() : current(new Batch()), leading(false), batchSize(SYNCGROUP_BATCH_SIZE), window(0), groups(0),
+                      requests(0)
         {
-            std::string str((std::istreambuf_iterator<char>(infile)),
-                            std::istreambuf_iterator<char>());
-            infile.close();
-
-            data[i] = str;
         }
 
-        if (data[i].empty())
+        /**
+         * Set how long leader waits for more writers
+         * @param size is number of writers that closes group early
+         * @param delay is longest wait of leader, zero groups only writers that arrive during running sync
+         */
+        void configure(size_t size, std::chrono::microseconds delay)
         {
-            emptyFileCounter++;
+            std::lock_guard<std::mutex> lock(groupMutex);
+            batchSize = size == 0 ? 1 : size;
+            window = delay;
         }
-    }
 
-    if (emptyFileCounter == 3)
-    {
-        return 2;
-    }
+        /**
+         * Wait until targets reach disk
+         * @param targets are files and folders to flush
+         * @return false if flush of group fails
+         */
+        bool sync(const std::vector<SyncTarget> &targets)
+        {
+            std::unique_lock<std::mutex> lock(groupMutex);
+            std::shared_ptr<Batch> batch = current;
+            for (auto &target : targets)
+            {
+                auto inserted = batch->roots[target.root].insert(std::make_pair(target.path, target.dataOnly));
+                inserted.first->second = inserted.first->second && target.dataOnly;
+            }
+            requests++;
+            if (++batch->writers >= batchSize)
+            {
+                groupCondition.notify_all();
+            }
 
-    if (emptyFileCounter == 2)
-    {
-        return 1;
-    }
+            while (!batch->done)
+            {
+                if (leading)
+                {
+                    groupCondition.wait(lock);
+                    continue;
+                }
 
-    return 0;
+                leading = true;
+                groupCondition.wait_for(lock, window, [this] { return current->writers >= batchSize; });
+                std::shared_ptr<Batch> sealed = current;
+                current = std::shared_ptr<Batch>(new Batch());
+                lock.unlock();
+
+                bool synced = true;
+                for (auto &root : sealed->roots)
+                {
+                    synced = syncRoot(root.first, root.second) && synced;
+                }
+
+                lock.lock();
+                sealed->synced = synced;
+                sealed->done = true;
+                leading = false;
+                groups++;
+                groupCondition.notify_all();
+            }
+
+            return batch->synced;
+        }
+    };
 }
 
 /**
- * Create unique key and iv for each dataKey
- * @param dataKey is string
- * @param key is byte that will be initialized
- * @param iv is byte that will be initialized
+ * Create path of temporary file no other writer uses, not even one in another process
+ * @param pathName is path to file temporary file will replace
+ * @return path to temporary file
  */
-void initializeKeyAndIV(const std::string &dataKey, CryptoPP::byte key[], CryptoPP::byte iv[])
+std::string tempFilePath(const std::string &pathName)
 {
-    CryptoPP::SecByteBlock derived(64);
-    std::string password = getUsername() + getUUID() + dataKey;
-    unsigned int iterations = 1000;
-
-    CryptoPP::PKCS5_PBKDF2_HMAC<CryptoPP::SHA256> kdf;
-    kdf.DeriveKey(derived.data(), derived.size(), 0,
-                  (CryptoPP::byte *) password.data(),
-                  password.size(), nullptr, 0, iterations);
+    static std::atomic<uint64_t> counter(0);
+#ifdef WIN32
+    unsigned long process = GetCurrentProcessId();
+#else
+    unsigned long process = (unsigned long) getpid();
+#endif
 
-    memcpy(key, derived.data(), CryptoPP::AES::MAX_KEYLENGTH);
-    memcpy(iv, derived.data() + CryptoPP::AES::MAX_KEYLENGTH, CryptoPP::AES::MAX_BLOCKSIZE);
+    return pathName + "." + std::to_string(process) + "-" + std::to_string(counter++) + ".tmp";
 }
 
 /**
- * Decrypth cipher text
- * @param dataKey is string
- * @param cipherText is string to be decrypted
- * @return result of decryption as string
+ * Remove temporary replicas left by processes that crashed while writing them. Caller holds lock of the
+ * folders, so temporary replicas of other processes are no longer written by anyone.
+ * @param rootPaths is array of paths to PISSD folders
  */
-std::string decrypthData(std::string dataKey, std::string cipherText)
+void removeStaleTempFiles(const std::string rootPaths[])
 {
-    CryptoPP::byte key[CryptoPP::AES::MAX_KEYLENGTH], iv[CryptoPP::AES::MAX_BLOCKSIZE];
-
-    std::string decryptedText;
+#ifdef WIN32
+    std::string process = std::to_string((unsigned long) GetCurrentProcessId());
+#else
+    std::string process = std::to_string((unsigned long) getpid());
+#endif
+    for (int i = 0; i < 3; ++i)
+    {
+        boost::system::error_code error;
+        boost::filesystem::recursive_directory_iterator it(rootPaths[i], error), eod;
+        for (; !error && it != eod; it.increment(error))
+        {
+            boost::filesystem::path const &p = it->path();
+            std::string fileName = p.filename().string();
+            if (fileName == SEGMENT_DIRECTORY)
+            {
+                it.no_push();
+                continue;
+            }
 
-    initializeKeyAndIV(dataKey, key, iv);
+            // Name is .<key>.jkl.<process>-<counter>.tmp as made by tempFilePath
+            size_t extension = fileName.rfind(".jkl.");
+            if (fileName.size() < 4 || fileName.compare(fileName.size() - 4, 4, ".tmp") != 0
+                || extension == std::string::npos)
+            {
+                continue;
+            }
+            std::string owner = fileName.substr(extension + 5);
+            if (owner.substr(0, owner.find('-')) != process)
+            {
+                boost::system::error_code removeError;
+                boost::filesystem::remove(p, removeError);
+            }
+        }
+    }
+}
 
-    CryptoPP::AES::Decryption aesDecryption(key, CryptoPP::AES::MAX_KEYLENGTH);
-    CryptoPP::CBC_Mode_ExternalCipher::Decryption cbcDecryption(aesDecryption, iv);
+/**
+ * Flush temporary replica, rename it over the old one and flush its folder as durability demands
+ * @param rootPath is path to PISSD folder
+ * @param tempPath is path to temporary replica created by tempFilePath
+ * @param pathName is path to replica
+ * @param written is true if temporary replica was written completely
+ * @param flushed is true if temporary replica already reached disk
+ * @param durability is what has to reach disk before replica counts as written
+ * @param syncGroup is group that flushes replica together with other replicas and concurrent writers
+ * @return true if replica was published
+ */
+bool publishFile(const std::string &rootPath, const std::string &tempPath, const std::string &pathName,
+                 bool written, bool flushed, PISSD::Durability durability, PISSD::SyncGroup &syncGroup)
+{
+    std::vector<PISSD::SyncTarget> targets(1, {rootPath, tempPath, true});
+    boost::system::error_code error;
 
-    try
+    // Temporary files of concurrent writers are flushed together before any of them is published
+    if (written && !flushed && durability != PISSD::Durability::None)
     {
-        CryptoPP::StreamTransformationFilter stfDecryptor(cbcDecryption, new CryptoPP::StringSink(decryptedText));
-        stfDecryptor.Put(reinterpret_cast<const unsigned char *>( cipherText.c_str()), cipherText.size());
-        stfDecryptor.MessageEnd();
+        written = syncGroup.sync(targets);
     }
-    catch (std::exception &e)
+    if (written)
     {
-        return "";
+        boost::filesystem::rename(tempPath, pathName, error);
+        written = !error;
     }
+    if (!written)
+    {
+        boost::filesystem::remove(tempPath, error);
+        return false;
+    }
+#ifdef WIN32
+    SetFileAttributes(pathName.c_str(), FILE_ATTRIBUTE_HIDDEN);
+#endif
 
-    decryptedText.erase(decryptedText.end() - SALTSIZE - 1, decryptedText.end());
-
-    return decryptedText;
+    targets[0] = {rootPath, boost::filesystem::path(pathName).parent_path().string(), false};
 
+    return durability != PISSD::Durability::DirectorySync || syncGroup.sync(targets);
 }
 
 /**
- * Check if original hash is same as new one
- * @param data to be checked
- * @return non-zero value if error occurs
+ * Save data to file in module of one PISSD folder, replica is written to temporary file of its own and
+ * renamed over the old one, so crash or concurrent writer leaves either old or new replica but never
+ * a truncated one
+ * @param rootPaths is array of paths to PISSD folders
+ * @param replica is index of PISSD folder
+ * @param module where file will be stored, empty for root
+ * @param fileName is string
+ * @param data is string that will be saved
+ * @param durability is what has to reach disk before replica counts as written
+ * @param syncGroup is group that flushes replica together with other replicas and concurrent writers
+ * @return true if replica was written
  */
-int checkHash(std::string data)
+bool createFile(const std::string rootPaths[], int replica, const std::string &module, const std::string &fileName,
+                const std::string &data, PISSD::Durability durability, PISSD::SyncGroup &syncGroup)
 {
-    if (data.size() < 90)
-    {
-        return 2;
-    }
-    std::string originalHash = data.substr(data.size() - 90);
-    data.erase(data.end() - 90, data.end());
-    std::string newHash = SHA512HashString(data);
-    if (originalHash != newHash)
+    std::string pathNames[3] = {rootPaths[0], rootPaths[1], rootPaths[2]};
+    if (!module.empty())
     {
-        return 1;
+        addModuleToPath(module, pathNames);
     }
+    pathNames[replica].append("/." + fileName + ".jkl");
 
-    return 0;
+    std::string tempPath = tempFilePath(pathNames[replica]);
+    std::ofstream outFile(tempPath, std::ios::out | std::ios::binary | std::ios::trunc);
+    outFile << data;
+    outFile.close();
+
+    return publishFile(rootPaths[replica], tempPath, pathNames[replica], (bool) outFile, false, durability, syncGroup);
 }
 
 /**
- * Find two same strings if they exist
- * @param possibleData is vector of strings to be seek
- * @return same strings, if no data are same, return empty string
+ * Return UUID of device
+ * @return UUID as string
  */
-std::string findSameStrings(std::vector<std::string> possibleData)
+std::string getUUID()
 {
-    if (possibleData.size() == 1)
+#ifdef WIN32
+    HW_PROFILE_INFO HwProfInfo;
+    if (!GetCurrentHwProfile(&HwProfInfo))
     {
-        return possibleData.front();
+        _tprintf(TEXT("GetCurrentHwProfile failed with error %lx\n"),
+                 GetLastError());
+    } else
+    {
+        return HwProfInfo.szHwProfileGuid;
     }
-    for (int i = 0; i < possibleData.size(); ++i)
+#endif
+
+#ifdef __APPLE__
+    struct timespec ts = { .tv_sec = 5, .tv_nsec = 0 };
+    uuid_t uuid = {};
+
+    if (gethostuuid(uuid, &ts) == -1) {
+        switch (errno) {
+            case EFAULT:
+                fputs("Failed to get system UUID: unknown error", stderr);
+                return NULL;
+            case EWOULDBLOCK:
+                fputs("Failed to get system UUID: timeout expired", stderr);
+                return NULL;
+        }
+    }
+
+    uuid_string_t uuid_string;
+    uuid_unparse_upper(uuid, uuid_string);
+
+    return uuid_string;
+#endif
+
+#ifdef __linux__
+    const char *machineIdPaths[] = {"/etc/machine-id", "/var/lib/dbus/machine-id"};
+    for (auto path : machineIdPaths)
     {
-        for (int j = i; j < possibleData.size(); ++j)
+        std::ifstream inFile(path);
+        std::string machineId;
+        if (std::getline(inFile, machineId) && !machineId.empty())
         {
-            if (i != j && possibleData[i] == possibleData[j])
-            {
-                return possibleData[i];
-            }
+            return machineId;
         }
     }
+#endif
 
     return "";
 }
 
 /**
- * Cipher plain text to cipher text by key and iv
- * @param plaintext is string to be ciphered
- * @param ciphertext is string with result of ciphering
- * @param key is byte
- * @param iv is byte
+ * Compare cipher text of replicas that were read
+ * @param data is array containing data
+ * @param loaded is array of flags of replicas that were read
+ * @return true if all of them are present and byte-identical
  */
-void encryptData(std::string &plaintext, std::string &ciphertext, CryptoPP::byte key[], CryptoPP::byte iv[])
+bool compareCiphertext(const std::string data[], const bool loaded[])
 {
-    CryptoPP::AES::Encryption aesEncryption(key, CryptoPP::AES::MAX_KEYLENGTH);
-    CryptoPP::CBC_Mode_ExternalCipher::Encryption cbcEncryption(aesEncryption, iv);
+    const std::string *first = nullptr;
 
-    CryptoPP::StreamTransformationFilter stfEncryptor(cbcEncryption, new CryptoPP::StringSink(ciphertext));
-    stfEncryptor.Put(reinterpret_cast<const unsigned char *>( plaintext.c_str()), plaintext.length() + 1);
-    stfEncryptor.MessageEnd();
-}
+    for (int i = 0; i < 3; ++i)
+    {
+        if (!loaded[i])
+        {
+            continue;
+        }
 
-/**
- * Create random string that will be used as salt
- * @param salt string containing result
- */
-void generateSalt(std::string &salt)
-{
-    CryptoPP::SecByteBlock saltGen(SALTSIZE);
-    CryptoPP::OS_GenerateRandomBlock(true, saltGen, saltGen.size());
+        if (data[i].empty() || (first != nullptr && data[i] != *first))
+        {
+            return false;
+        }
+        first = &data[i];
+    }
 
-    std::string saltString((char *) saltGen.data(), saltGen.size());
-    salt = saltString;
+    return first != nullptr;
 }
 
 /**
- * Append file and module to path
- * @param pathToDir is string
- * @param module is string
- * @param name is string
+ * Find replica that has byte-identical copy
+ * @param data is array containing data
+ * @return index of replica agreed by at least two copies, -1 if replicas diverge
  */
-void createPath(std::string &pathToDir, const std::string &module, const std::string &name)
+int findQuorum(const std::string data[])
 {
-    if (module.front() == '/')
-    {
-        pathToDir += module;
-    } else
+    for (int i = 0; i < 3; ++i)
     {
-        pathToDir += "/" + module;
+        for (int j = i + 1; j < 3; ++j)
+        {
+            if (!data[i].empty() && data[i] == data[j])
+            {
+                return i;
+            }
+        }
     }
 
-    if (module.back() == '/')
-    {
-        pathToDir += name;
-    } else
-    {
-        pathToDir += "/" + name;
-    }
+    return -1;
 }
 
-namespace PISSD
+/**
+ * Open file from module of one PISSD folder and put its content to data
+ * @param rootPaths is array of paths to PISSD folders
+ * @param replica is index of PISSD folder
+ * @param module where file should exists, empty for root
+ * @param data is string where replica will be stored, it stays empty if there is no replica
+ * @param fileName is string
+ * @return false if replica was not found
+ */
+bool loadFile(const std::string rootPaths[], int replica, const std::string &module, std::string &data,
+              const std::string &fileName)
 {
-    /**
-     * Create instance of PISSD library
-     * @param mMutex is pointer to mutex
-     */
-    SecureDataStorage::SecureDataStorage(std::mutex * mMutex)
+    std::string dirPath[3] = {rootPaths[0], rootPaths[1], rootPaths[2]};
+
+    if (!module.empty())
     {
-        lgMutex = mMutex;
+        addModuleToPath(module, dirPath);
     }
 
-    /**
-     * Store and cipher data
-     * @param dataKey is string containing key
-     * @param data is string to be stored
-     * @return non-zero value if error occurs
-     */
-    int SecureDataStorage::storeData(const std::string &dataKey, std::string &data)
+    data.clear();
+    dirPath[replica].append("/." + fileName + ".jkl");
+    std::ifstream infile(dirPath[replica], std::ifstream::binary);
+    if (infile.is_open())
     {
-        CryptoPP::byte key[CryptoPP::AES::MAX_KEYLENGTH], iv[CryptoPP::AES::MAX_KEYLENGTH];
+        data.assign((std::istreambuf_iterator<char>(infile)), std::istreambuf_iterator<char>());
+        infile.close();
+    }
 
-        CryptoPP::SecByteBlock derived(64);
+    return !data.empty();
+}
 
-        std::string saltString;
-        generateSalt(saltString);
+#ifdef PISSD_IO_URING
 
-        std::string plaintext = "str" + data;
-        std::string ciphertext;
+/**
+ * Submission queue of calling thread, kernels without io_uring or without any of the requests used here
+ * leave it unusable and stream I/O is used. Files are opened into the only slot of its fixed file table,
+ * so the whole life of a file is linked inside the ring and the caller never holds its descriptor.
+ */
+struct UringQueue
+{
+    struct io_uring ring;
+    bool ready;
 
-        plaintext += SHA512HashString(plaintext) + saltString;
+    UringQueue()
+    {
+        if (io_uring_queue_init(URING_ENTRIES, &ring, 0) != 0)
+        {
+            ring.ring_fd = -1;
+            ready = false;
+            return;
+        }
+        ready = true;
 
-        initializeKeyAndIV(dataKey, key, iv);
+        struct io_uring_probe *probe = io_uring_get_probe_ring(&ring);
+        const int opcodes[] = {IORING_OP_STATX, IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_WRITE, IORING_OP_FSYNC,
+                               IORING_OP_CLOSE};
+        for (int opcode : opcodes)
+        {
+            ready = ready && probe && io_uring_opcode_supported(probe, opcode);
+        }
+        if (probe)
+        {
+            io_uring_free_probe(probe);
+        }
 
-        encryptData(plaintext, ciphertext, key, iv);
-        std::lock_guard<std::mutex> lock(*lgMutex);
+        int files[1] = {-1};
+        ready = ready && io_uring_register_files(&ring, files, 1) == 0;
 
-        createFile(dataKey.c_str(), ciphertext);
+        // Kernels before direct open ignore the slot and return plain descriptor, their close would not take slot
+        int results[1] = {-1};
+        if (ready)
+        {
+            io_uring_prep_openat_direct(prepare(0, 0), AT_FDCWD, "/", O_RDONLY | O_CLOEXEC, 0, URING_SLOT);
+            ready = run(1, results) && results[0] == 0;
+        }
+        if (results[0] > 0)
+        {
+            close(results[0]);
+        }
+        if (ready)
+        {
+            io_uring_prep_close_direct(prepare(0, 0), URING_SLOT);
+            ready = run(1, results) && results[0] == 0;
+        }
+    }
 
-        return 0;
+    ~UringQueue()
+    {
+        if (ring.ring_fd >= 0)
+        {
+            io_uring_queue_exit(&ring);
+        }
     }
 
     /**
-     * Store and cipher data
-     * @param dataKey is string containing key
-     * @param data is double to be stored
-     * @return non-zero value if error occurs
+     * Submit prepared requests and wait for all of them. Queue that fails is not used again, requests
+     * left in it are never submitted.
+     * @param count is number of prepared requests
+     * @param results is array indexed by user data of requests where their results will be stored
+     * @return false if requests were not submitted or their results were lost
      */
-    int SecureDataStorage::storeData(const std::string &dataKey, double &data)
+    bool run(unsigned count, int results[])
     {
-        CryptoPP::byte key[CryptoPP::AES::MAX_KEYLENGTH], iv[CryptoPP::AES::MAX_KEYLENGTH];
-
-        CryptoPP::SecByteBlock derived(64);
-
-        std::string saltString;
-        generateSalt(saltString);
-
-        std::string plaintext = "dbl" + std::to_string(data);
-        std::string ciphertext;
-
-        plaintext += SHA512HashString(plaintext) + saltString;
-
-        initializeKeyAndIV(dataKey, key, iv);
+        int submitted;
+        do
+        {
+            submitted = io_uring_submit(&ring);
+        } while (submitted == -EINTR);
 
-        encryptData(plaintext, ciphertext, key, iv);
+        if (submitted < 0)
+        {
+            ready = false;
+            return false;
+        }
 
-        std::lock_guard<std::mutex> lock(*lgMutex);
+        for (unsigned i = 0; i < count; ++i)
+        {
+            struct io_uring_cqe *cqe;
+            int waited;
+            do
+            {
+                waited = io_uring_wait_cqe(&ring, &cqe);
+            } while (waited == -EINTR);
 
-        createFile(dataKey.c_str(), ciphertext);
+            if (waited < 0)
+            {
+                ready = false;
+                return false;
+            }
+            results[(uintptr_t) io_uring_cqe_get_data(cqe)] = cqe->res;
+            io_uring_cqe_seen(&ring, cqe);
+        }
 
-        return 0;
+        return true;
     }
 
     /**
-     * Store and cipher data
-     * @param dataKey is string containing key
-     * @param data is float to be stored
-     * @return non-zero value if error occurs
+     * Prepare request
+     * @param index is index of result of request
+     * @param flags are flags of request, IOSQE_IO_LINK runs the next one only if this one succeeds and
+     * IOSQE_IO_HARDLINK runs it anyway
+     * @return prepared request
      */
-    int SecureDataStorage::storeData(const std::string &dataKey, float &data)
+    struct io_uring_sqe *prepare(uintptr_t index, unsigned flags)
     {
-        CryptoPP::byte key[CryptoPP::AES::MAX_KEYLENGTH], iv[CryptoPP::AES::MAX_KEYLENGTH];
+        struct io_uring_sqe *sqe = io_uring_get_sqe(&ring);
+        io_uring_sqe_set_data(sqe, (void *) index);
+        io_uring_sqe_set_flags(sqe, flags);
 
-        CryptoPP::SecByteBlock derived(64);
-
-        std::string saltString;
-        generateSalt(saltString);
+        return sqe;
+    }
+};
 
-        std::string plaintext = "flt" + std::to_string(data);
-        std::string ciphertext;
+/**
+ * Queue of calling thread
+ * @return queue, check its ready flag before use
+ */
+UringQueue &uringQueue()
+{
+    static thread_local UringQueue queue;
 
-        plaintext += SHA512HashString(plaintext) + saltString;
+    return queue;
+}
 
-        initializeKeyAndIV(dataKey, key, iv);
+/**
+ * Load replica from one PISSD folder like loadFile, open and size of replica are submitted at once
+ * and so are its read and close. File left open in slot by failed queue is closed when slot is reused.
+ * @param queue is ready queue of calling thread
+ * @param rootPaths is array of paths to PISSD folders
+ * @param replica is index of PISSD folder
+ * @param module is path to module, empty for root
+ * @param data is string where replica will be stored, it stays empty if there is no replica
+ * @param fileName is name of key
+ * @return false if replica was not found
+ */
+bool uringLoadFile(UringQueue &queue, const std::string rootPaths[], int replica, const std::string &module,
+                   std::string &data, const std::string &fileName)
+{
+    std::string dirPath[3] = {rootPaths[0], rootPaths[1], rootPaths[2]};
+    struct statx stats;
+    int results[3];
+    unsigned count = 0;
 
-        encryptData(plaintext, ciphertext, key, iv);
+    if (!module.empty())
+    {
+        addModuleToPath(module, dirPath);
+    }
 
-        std::lock_guard<std::mutex> lock(*lgMutex);
+    data.clear();
+    dirPath[replica].append("/." + fileName + ".jkl");
+    io_uring_prep_statx(queue.prepare(0, 0), AT_FDCWD, dirPath[replica].c_str(), 0, STATX_SIZE, &stats);
+    io_uring_prep_openat_direct(queue.prepare(1, 0), AT_FDCWD, dirPath[replica].c_str(), O_RDONLY | O_CLOEXEC, 0,
+                                URING_SLOT);
+    if (!queue.run(2, results))
+    {
+        return loadFile(rootPaths, replica, module, data, fileName);
+    }
 
-        createFile(dataKey.c_str(), ciphertext);
+    if (results[1] < 0)
+    {
+        return false;
+    }
 
-        return 0;
+    if (results[0] == 0 && stats.stx_size > 0)
+    {
+        data.resize(stats.stx_size);
+        io_uring_prep_read(queue.prepare(0, IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK), URING_SLOT, &data[0],
+                           data.size(), 0);
+        count++;
     }
+    io_uring_prep_close_direct(queue.prepare(2, 0), URING_SLOT);
+    count++;
 
-    /**
-     * Store and cipher data
-     * @param dataKey is string containing key
-     * @param data is int64 to be stored
-     * @return non-zero value if error occurs
-     */
-    int SecureDataStorage::storeData(const std::string &dataKey, int64_t &data)
+    results[0] = -1;
+    if (!queue.run(count, results))
     {
-        CryptoPP::byte key[CryptoPP::AES::MAX_KEYLENGTH], iv[CryptoPP::AES::MAX_KEYLENGTH];
+        return loadFile(rootPaths, replica, module, data, fileName);
+    }
 
-        CryptoPP::SecByteBlock derived(64);
+    if (results[0] != (int) data.size())
+    {
+        data.clear();
+    }
+
+    return !data.empty();
+}
+
+/**
+ * Save data to one PISSD folder like createFile, open, write, flush and close of temporary replica are
+ * linked in one submission, so failure of any of them cancels the rest
+ * @param queue is ready queue of calling thread
+ * @param rootPaths is array of paths to PISSD folders
+ * @param replica is index of PISSD folder
+ * @param module where file will be stored, empty for root
+ * @param fileName is name of key
+ * @param data is string that will be saved
+ * @param durability is what has to reach disk before replica counts as written
+ * @param syncGroup is group that flushes folder together with other replicas and concurrent writers
+ * @return true if replica was written
+ */
+bool uringCreateFile(UringQueue &queue, const std::string rootPaths[], int replica, const std::string &module,
+                     const std::string &fileName, const std::string &data, PISSD::Durability durability,
+                     PISSD::SyncGroup &syncGroup)
+{
+    std::string pathNames[3] = {rootPaths[0], rootPaths[1], rootPaths[2]};
+    int results[4] = {-1, -1, -1, -1};
+    unsigned count = 0;
+
+    if (!module.empty())
+    {
+        addModuleToPath(module, pathNames);
+    }
+    pathNames[replica].append("/." + fileName + ".jkl");
+    std::string tempPath = tempFilePath(pathNames[replica]);
+    bool flushed = durability != PISSD::Durability::None;
+
+    // Failed or short write must not cancel close of the slot, so only failed open ends the chain
+    io_uring_prep_openat_direct(queue.prepare(count++, IOSQE_IO_LINK), AT_FDCWD, tempPath.c_str(),
+                                O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666, URING_SLOT);
+    io_uring_prep_write(queue.prepare(count++, IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK), URING_SLOT, data.data(),
+                        data.size(), 0);
+    if (flushed)
+    {
+        io_uring_prep_fsync(queue.prepare(count++, IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK), URING_SLOT,
+                            IORING_FSYNC_DATASYNC);
+    }
+    io_uring_prep_close_direct(queue.prepare(count++, 0), URING_SLOT);
+    if (!queue.run(count, results))
+    {
+        boost::system::error_code error;
+        boost::filesystem::remove(tempPath, error);
+        return createFile(rootPaths, replica, module, fileName, data, durability, syncGroup);
+    }
+
+    bool written = results[0] == 0 && results[1] == (int) data.size() && (!flushed || results[2] == 0)
+                   && results[count - 1] == 0;
+
+    return publishFile(rootPaths[replica], tempPath, pathNames[replica], written, flushed, durability, syncGroup);
+}
+
+#endif
+
+/**
+ * Create unique key and iv for each dataKey, used only for records without header
+ * @param identity is username and UUID of device
+ * @param dataKey is string
+ * @param key is byte that will be initialized
+ * @param iv is byte that will be initialized
+ */
+void initializeKeyAndIV(const std::string &identity, const std::string &dataKey,
+                        CryptoPP::byte key[], CryptoPP::byte iv[])
+{
+    CryptoPP::SecByteBlock derived(64);
+    std::string password = identity + dataKey;
+    unsigned int iterations = 1000;
+
+    CryptoPP::PKCS5_PBKDF2_HMAC<CryptoPP::SHA256> kdf;
+    kdf.DeriveKey(derived.data(), derived.size(), 0,
+                  (CryptoPP::byte *) password.data(),
+                  password.size(), nullptr, 0, iterations);
+
+    memcpy(key, derived.data(), CryptoPP::AES::MAX_KEYLENGTH);
+    memcpy(iv, derived.data() + CryptoPP::AES::MAX_KEYLENGTH, CryptoPP::AES::MAX_BLOCKSIZE);
+}
+
+/**
+ * Derive master secret of this user and device, it is computed only once per instance
+ * @param identity is username and UUID of device
+ * @param masterKey is block that will be initialized
+ */
+void initializeMasterKey(const std::string &identity, CryptoPP::SecByteBlock &masterKey)
+{
+    const std::string &password = identity;
+    const std::string salt = "PISSD master key";
+
+    CryptoPP::PKCS5_PBKDF2_HMAC<CryptoPP::SHA256> kdf;
+    kdf.DeriveKey(masterKey.data(), masterKey.size(), 0,
+                  (CryptoPP::byte *) password.data(), password.size(),
+                  (CryptoPP::byte *) salt.data(), salt.size(), MASTERKEY_ITERATIONS);
+}
+
+/**
+ * Expand master secret to key and iv for dataKey
+ * @param masterKey is secret created by initializeMasterKey
+ * @param dataKey is string
+ * @param key is byte that will be initialized
+ * @param iv is byte that will be initialized
+ */
+void deriveKeyAndIV(const CryptoPP::SecByteBlock &masterKey, const std::string &dataKey,
+                    CryptoPP::byte key[], CryptoPP::byte iv[])
+{
+    CryptoPP::SecByteBlock derived(CryptoPP::AES::MAX_KEYLENGTH + CryptoPP::AES::MAX_BLOCKSIZE);
+    std::string info = "PISSD key " + dataKey;
+
+    CryptoPP::HKDF<CryptoPP::SHA256> hkdf;
+    hkdf.DeriveKey(derived.data(), derived.size(), masterKey.data(), masterKey.size(),
+                   nullptr, 0, (CryptoPP::byte *) info.data(), info.size());
+
+    memcpy(key, derived.data(), CryptoPP::AES::MAX_KEYLENGTH);
+    memcpy(iv, derived.data() + CryptoPP::AES::MAX_KEYLENGTH, CryptoPP::AES::MAX_BLOCKSIZE);
+}
+
+/**
+ * Create header of stored record
+ * @param version is format version of record
+ * @return header as string
+ */
+std::string recordHeader(int version)
+{
+    return std::string(RECORD_MAGIC) + (char) version;
+}
+
+/**
+ * Find format version of stored record
+ * @param record is content of replica
+ * @return version of record, 0 for records without header
+ */
+int recordVersion(const std::string &record)
+{
+    if (record.size() <= RECORD_HEADER_SIZE || record.compare(0, RECORD_HEADER_SIZE - 1, RECORD_MAGIC) != 0)
+    {
+        return 0;
+    }
+
+    return (unsigned char) record[RECORD_HEADER_SIZE - 1];
+}
+
+/**
+ * Decrypth cipher text
+ * @param material is key material of dataKey
+ * @param cipherText is string to be decrypted
+ * @return result of decryption as string
+ */
+std::string decrypthData(KeyMaterial &material, const std::string &cipherText)
+{
+    if (cipherText.empty() || cipherText.size() % CryptoPP::AES::BLOCKSIZE != 0)
+    {
+        return "";
+    }
+
+    std::string decryptedText(cipherText.size(), '\0');
+
+    // Legacy records are only read, so their decryptor is keyed per call instead of being pooled
+    CryptoPP::CBC_Mode<CryptoPP::AES>::Decryption decryption(material.key, material.key.size(), material.iv);
+    decryption.ProcessData((CryptoPP::byte *) &decryptedText[0], (const CryptoPP::byte *) cipherText.data(),
+                           cipherText.size());
+
+    // Remove PKCS #7 padding
+    size_t padding = (unsigned char) decryptedText.back();
+    if (padding == 0 || padding > CryptoPP::AES::BLOCKSIZE
+        || decryptedText.find_first_not_of((char) padding, decryptedText.size() - padding) != std::string::npos)
+    {
+        return "";
+    }
+    decryptedText.resize(decryptedText.size() - padding);
+
+    if (decryptedText.size() < SALTSIZE + 1)
+    {
+        return "";
+    }
+
+    decryptedText.erase(decryptedText.end() - SALTSIZE - 1, decryptedText.end());
+
+    return decryptedText;
+
+}
+
+/**
+ * Check if original hash is same as new one
+ * @param data to be checked
+ * @return non-zero value if error occurs
+ */
+int checkHash(std::string data)
+{
+    if (data.size() < 90)
+    {
+        return 2;
+    }
+    std::string originalHash = data.substr(data.size() - 90);
+    data.erase(data.end() - 90, data.end());
+    std::string newHash = SHA512HashString(data);
+    if (originalHash != newHash)
+    {
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Find two same strings if they exist
+ * @param possibleData is vector of strings to be seek
+ * @return same strings, if no data are same, return empty string
+ */
+std::string findSameStrings(std::vector<std::string> possibleData)
+{
+    if (possibleData.size() == 1)
+    {
+        return possibleData.front();
+    }
+    for (int i = 0; i < possibleData.size(); ++i)
+    {
+        for (int j = i; j < possibleData.size(); ++j)
+        {
+            if (i != j && possibleData[i] == possibleData[j])
+            {
+                return possibleData[i];
+            }
+        }
+    }
+
+    return "";
+}
+
+/**
+ * Cipher and authenticate plain text in one pass
+ * @param plaintext is string to be ciphered
+ * @param record is header, nonce, cipher text and tag as string
+ * @param material is key material of dataKey
+ * @param nonce is random string of NONCESIZE bytes
+ */
+void encryptRecord(const std::string &plaintext, std::string &record, KeyMaterial &material,
+                   const std::string &nonce)
+{
+    record = recordHeader(RECORD_V3) + nonce;
+    record.resize(RECORD_HEADER_SIZE + NONCESIZE + plaintext.size() + TAGSIZE);
+
+    CryptoPP::byte *output = (CryptoPP::byte *) &record[RECORD_HEADER_SIZE + NONCESIZE];
+
+    CipherLease contexts(material);
+    contexts->gcmEncryption.EncryptAndAuthenticate(output, output + plaintext.size(), TAGSIZE,
+                                                   (const CryptoPP::byte *) nonce.data(), NONCESIZE,
+                                                   (const CryptoPP::byte *) record.data(), RECORD_HEADER_SIZE,
+                                                   (const CryptoPP::byte *) plaintext.data(), plaintext.size());
+}
+
+/**
+ * Decipher record created by encryptRecord and verify its tag
+ * @param material is key material of dataKey
+ * @param record is content of replica
+ * @param plaintext is string with result of deciphering
+ * @return true if record is authentic
+ */
+bool decryptRecord(KeyMaterial &material, const std::string &record, std::string &plaintext)
+{
+    if (record.size() < RECORD_HEADER_SIZE + NONCESIZE + TAGSIZE)
+    {
+        return false;
+    }
+
+    const CryptoPP::byte *nonce = (const CryptoPP::byte *) record.data() + RECORD_HEADER_SIZE;
+    const CryptoPP::byte *cipherText = nonce + NONCESIZE;
+    size_t cipherTextSize = record.size() - RECORD_HEADER_SIZE - NONCESIZE - TAGSIZE;
+
+    plaintext.resize(cipherTextSize);
+
+    CipherLease contexts(material);
+    return contexts->gcmDecryption.DecryptAndVerify((CryptoPP::byte *) &plaintext[0], cipherText + cipherTextSize,
+                                                    TAGSIZE, nonce, NONCESIZE, (const CryptoPP::byte *) record.data(),
+                                                    RECORD_HEADER_SIZE, cipherText, cipherTextSize);
+}
+
+/**
+ * Serialize value as type tag followed by fixed-width little-endian payload
+ * @param type is type tag of value
+ * @param bits is value to be serialized
+ * @param size is width of payload in bytes
+ * @return serialized value as string
+ */
+std::string encodeValue(char type, uint64_t bits, int size)
+{
+    std::string encoded(1, type);
+    for (int i = 0; i < size; ++i)
+    {
+        encoded += (char) ((bits >> (8 * i)) & 0xff);
+    }
+
+    return encoded;
+}
+
+/**
+ * Read little-endian payload created by encodeValue
+ * @param payload is serialized value without type tag
+ * @return value as unsigned integer
+ */
+uint64_t decodeValue(const std::string &payload)
+{
+    uint64_t bits = 0;
+    for (size_t i = payload.size(); i > 0; --i)
+    {
+        bits = (bits << 8) | (unsigned char) payload[i - 1];
+    }
+
+    return bits;
+}
+
+/**
+ * Check if plain text holds value of desired type
+ * @param plaintext is type tag followed by serialized value
+ * @param type is expected type tag
+ * @return true if tag and payload width match
+ */
+bool checkValue(const std::string &plaintext, char type)
+{
+    if (plaintext.empty() || plaintext[0] != type)
+    {
+        return false;
+    }
+
+    switch (type)
+    {
+        case VALUE_DOUBLE:
+        case VALUE_INT64:
+            return plaintext.size() == 9;
+        case VALUE_FLOAT:
+            return plaintext.size() == 5;
+        case VALUE_BOOL:
+            return plaintext.size() == 2;
+        default:
+            return true;
+    }
+}
+
+/**
+ * Convert value of records without header, which were stored as text after 3 letter tag
+ * @param plaintext is value that will be converted to binary encoding
+ * @return true if value was recognized
+ */
+bool convertTextValue(std::string &plaintext)
+{
+    std::string type = plaintext.substr(0, 3);
+    std::string text = plaintext.size() > 3 ? plaintext.substr(3) : "";
+
+    try
+    {
+        if (type == "str")
+        {
+            plaintext = (char) VALUE_STRING + text;
+        } else if (type == "dbl")
+        {
+            double value = std::stod(text);
+            uint64_t bits;
+            memcpy(&bits, &value, sizeof(bits));
+            plaintext = encodeValue(VALUE_DOUBLE, bits, sizeof(bits));
+        } else if (type == "flt")
+        {
+            float value = std::stof(text);
+            uint32_t bits;
+            memcpy(&bits, &value, sizeof(bits));
+            plaintext = encodeValue(VALUE_FLOAT, bits, sizeof(bits));
+        } else if (type == "int")
+        {
+            plaintext = encodeValue(VALUE_INT64, (uint64_t) std::stoll(text), sizeof(int64_t));
+        } else if (type == "bol" && (text == "true" || text == "false"))
+        {
+            plaintext = encodeValue(VALUE_BOOL, text == "true", 1);
+        } else
+        {
+            return false;
+        }
+    }
+    catch (std::exception &e)
+    {
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Decipher replica in current format or legacy one without header and check its integrity
+ * @param identity is username and UUID of device
+ * @param dataKey is string
+ * @param material is key material of dataKey, material of records without header is derived into it
+ * @param record is content of replica
+ * @param plaintext is binary type tag followed by serialized value
+ * @return true if record is authentic
+ */
+bool openRecord(const std::string &identity, const std::string &dataKey, KeyMaterial &material,
+                const std::string &record, std::string &plaintext)
+{
+    int version = recordVersion(record);
+
+    if (version == RECORD_V3 && decryptRecord(material, record, plaintext))
+    {
+        return true;
+    }
+
+    // Legacy records are plain CBC output, a matching header may only be a coincidence
+    if (record.size() % CryptoPP::AES::BLOCKSIZE != 0)
+    {
+        return false;
+    }
+
+    // Slow derivation runs once per cached dataKey, replicas verified in parallel share its result
+    std::call_once(material.legacyOnce, [&]
+    {
+        CryptoPP::SecByteBlock derived(CryptoPP::AES::MAX_KEYLENGTH + CryptoPP::AES::MAX_BLOCKSIZE);
+        initializeKeyAndIV(identity, dataKey, derived.data(), derived.data() + CryptoPP::AES::MAX_KEYLENGTH);
+        material.legacy.reset(new KeyMaterial(derived.data(), derived.data() + CryptoPP::AES::MAX_KEYLENGTH));
+    });
+    plaintext = decrypthData(*material.legacy, record);
+
+    if (checkHash(plaintext) != 0)
+    {
+        return false;
+    }
+    plaintext.erase(plaintext.end() - 90, plaintext.end());
+
+    return convertTextValue(plaintext);
+}
+
+/**
+ * Encode position of key in listing as opaque resume token
+ * @param module is normalized path to module
+ * @param key is name of key
+ * @return token as hexadecimal string
+ */
+std::string encodeResumeToken(const std::string &module, const std::string &key)
+{
+    static const char digits[] = "0123456789abcdef";
+    std::string plain = module + '\0' + key;
+    std::string token;
+
+    for (unsigned char c : plain)
+    {
+        token += digits[c >> 4];
+        token += digits[c & 0x0f];
+    }
+
+    return token;
+}
+
+/**
+ * Decode token created by encodeResumeToken
+ * @param token is hexadecimal string
+ * @param module is normalized path to module
+ * @param key is name of key
+ * @return true if token is valid
+ */
+bool decodeResumeToken(const std::string &token, std::string &module, std::string &key)
+{
+    std::string plain;
+    if (token.size() % 2 != 0)
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < token.size(); i += 2)
+    {
+        int high = isxdigit(token[i]) ? std::stoi(token.substr(i, 1), nullptr, 16) : -1;
+        int low = isxdigit(token[i + 1]) ? std::stoi(token.substr(i + 1, 1), nullptr, 16) : -1;
+        if (high < 0 || low < 0)
+        {
+            return false;
+        }
+        plain += (char) (high << 4 | low);
+    }
+
+    size_t separator = plain.find('\0');
+    if (separator == std::string::npos)
+    {
+        return false;
+    }
+    module = plain.substr(0, separator);
+    key = plain.substr(separator + 1);
+
+    return true;
+}
+
+/**
+ * Serialize manifest entry as type, module and key, both prefixed by little-endian length
+ * @param type is type of entry
+ * @param module is normalized path to module
+ * @param key is name of key, empty for module entries
+ * @return serialized entry as string
+ */
+std::string encodeManifestEntry(char type, const std::string &module, const std::string &key)
+{
+    return std::string(1, type) + encodeValue(0, module.size(), 4).substr(1) + module
+           + encodeValue(0, key.size(), 4).substr(1) + key;
+}
+
+/**
+ * Read manifest entry created by encodeManifestEntry
+ * @param data is serialized manifest
+ * @param position is offset of entry, it is moved behind the entry
+ * @param type is type of entry
+ * @param module is normalized path to module
+ * @param key is name of key
+ * @return false if entry is truncated
+ */
+bool decodeManifestEntry(const std::string &data, size_t &position, char &type, std::string &module,
+                         std::string &key)
+{
+    std::string *fields[2] = {&module, &key};
+
+    if (position >= data.size())
+    {
+        return false;
+    }
+    type = data[position++];
+
+    for (auto field : fields)
+    {
+        if (data.size() - position < 4)
+        {
+            return false;
+        }
+        uint64_t length = decodeValue(data.substr(position, 4));
+        position += 4;
+        if (data.size() - position < length)
+        {
+            return false;
+        }
+        *field = data.substr(position, length);
+        position += length;
+    }
+
+    return true;
+}
+
+/**
+ * Read whole file at once
+ * @param path is path to file
+ * @param data is string where content will be stored
+ * @return false if file cannot be read
+ */
+bool readWholeFile(const std::string &path, std::string &data)
+{
+    std::ifstream inFile(path, std::ios::in | std::ios::binary);
+    if (!inFile)
+    {
+        return false;
+    }
+    data.assign(std::istreambuf_iterator<char>(inFile), std::istreambuf_iterator<char>());
+
+    return !inFile.bad();
+}
+
+/**
+ * Remove leading and trailing slashes from module path
+ * @param module is path to module
+ * @return module path in form "a/b", empty for root
+ */
+std::string normalizeModule(std::string module)
+{
+    size_t first = module.find_first_not_of('/');
+    if (first == std::string::npos)
+    {
+        return "";
+    }
+    size_t last = module.find_last_not_of('/');
+
+    return module.substr(first, last - first + 1);
+}
+
+/**
+ * Append file and module to path
+ * @param pathToDir is string
+ * @param module is string
+ * @param name is string
+ */
+void createPath(std::string &pathToDir, const std::string &module, const std::string &name)
+{
+    if (module.front() == '/')
+    {
+        pathToDir += module;
+    } else
+    {
+        pathToDir += "/" + module;
+    }
+
+    if (module.back() == '/')
+    {
+        pathToDir += name;
+    } else
+    {
+        pathToDir += "/" + name;
+    }
+}
+
+namespace PISSD
+{
+    /**
+     * Bounded LRU cache of key material derived from master key
+     */
+    class KeyCache
+    {
+    private:
+        typedef std::pair<std::string, std::shared_ptr<KeyMaterial>> Entry;
+
+        std::mutex cacheMutex;
+        size_t capacity;
+        std::list<Entry> entries;
+        std::unordered_map<std::string, std::list<Entry>::iterator> lookup;
+
+    public:
+        std::atomic<uint64_t> hits;
+        std::atomic<uint64_t> misses;
+
+        explicit KeyCache(size_t maxEntries) : capacity(maxEntries), hits(0), misses(0)
+        {
+        }
+
+        /**
+         * Find key material of dataKey or derive it and remember it
+         * @param masterKey is secret created by initializeMasterKey
+         * @param dataKey is string
+         * @return key material, it stays valid even if it is evicted meanwhile
+         */
+        std::shared_ptr<KeyMaterial> get(const CryptoPP::SecByteBlock &masterKey, const std::string &dataKey)
+        {
+            {
+                std::lock_guard<std::mutex> lock(cacheMutex);
+                auto found = lookup.find(dataKey);
+                if (found != lookup.end())
+                {
+                    entries.splice(entries.begin(), entries, found->second);
+                    hits++;
+                    return found->second->second;
+                }
+            }
+            misses++;
+
+            CryptoPP::SecByteBlock derived(CryptoPP::AES::MAX_KEYLENGTH + CryptoPP::AES::MAX_BLOCKSIZE);
+            deriveKeyAndIV(masterKey, dataKey, derived.data(), derived.data() + CryptoPP::AES::MAX_KEYLENGTH);
+            auto material = std::make_shared<KeyMaterial>(derived.data(),
+                                                          derived.data() + CryptoPP::AES::MAX_KEYLENGTH);
+
+            std::lock_guard<std::mutex> lock(cacheMutex);
+            if (capacity == 0 || lookup.count(dataKey) != 0)
+            {
+                return material;
+            }
+            entries.emplace_front(dataKey, material);
+            lookup[dataKey] = entries.begin();
+            shrink();
+
+            return material;
+        }
+
+        /**
+         * Change maximal number of entries, evicting the least recently used ones
+         * @param maxEntries is new capacity, zero disables caching
+         */
+        void resize(size_t maxEntries)
+        {
+            std::lock_guard<std::mutex> lock(cacheMutex);
+            capacity = maxEntries;
+            shrink();
+        }
+
+        /**
+         * Forget all entries
+         */
+        void clear()
+        {
+            std::lock_guard<std::mutex> lock(cacheMutex);
+            lookup.clear();
+            entries.clear();
+        }
+
+    private:
+        void shrink()
+        {
+            while (entries.size() > capacity)
+            {
+                lookup.erase(entries.back().first);
+                entries.pop_back();
+            }
+        }
+    };
+
+    /**
+     * Buffer of random bytes used as salts and nonces. Generator is seeded once from non-blocking
+     * OS entropy, so stores never wait for the blocking entropy source. Child created by fork would
+     * hand out the same bytes as its parent, so it reseeds and drops the buffer it inherited.
+     */
+    class SaltPool
+    {
+    private:
+        std::mutex poolMutex;
+        CryptoPP::AutoSeededRandomPool generator;
+        CryptoPP::SecByteBlock buffer;
+        size_t position;
+        long owner;
+
+        static long processId()
+        {
+#ifdef WIN32
+            return (long) GetCurrentProcessId();
+#else
+            return (long) getpid();
+#endif
+        }
+
+    public:
+        SaltPool() : buffer(SALTPOOL_SIZE), position(SALTPOOL_SIZE), owner(processId())
+        {
+        }
+
+        /**
+         * Create random string that will be used as salt
+         * @param salt string containing result
+         * @param size is number of random bytes
+         */
+        void generate(std::string &salt, size_t size)
+        {
+            std::lock_guard<std::mutex> lock(poolMutex);
+            salt.resize(size);
+
+            if (owner != processId())
+            {
+                generator.Reseed(false);
+                memset(buffer.data(), 0, buffer.size());
+                position = buffer.size();
+                owner = processId();
+            }
+
+            size_t copied = 0;
+            while (copied < size)
+            {
+                if (position == buffer.size())
+                {
+                    generator.GenerateBlock(buffer, buffer.size());
+                    position = 0;
+                }
+
+                size_t chunk = std::min(size - copied, buffer.size() - position);
+                memcpy(&salt[copied], buffer.data() + position, chunk);
+                memset(buffer.data() + position, 0, chunk);
+                position += chunk;
+                copied += chunk;
+            }
+        }
+    };
+
+    /**
+     * Small pool of threads running work of SecureDataStorage, like deciphering replicas in parallel
+     */
+    class WorkerPool
+    {
+    private:
+        std::mutex queueMutex;
+        std::condition_variable queueCondition;
+        std::deque<std::function<void()>> tasks;
+        std::vector<std::thread> workers;
+        bool stopping;
+
+    public:
+        explicit WorkerPool(unsigned threads) : stopping(false)
+        {
+            for (unsigned i = 0; i < threads; ++i)
+            {
+                workers.emplace_back([this] { run(); });
+            }
+        }
+
+        /**
+         * Finish queued tasks and stop all threads
+         */
+        ~WorkerPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(queueMutex);
+                stopping = true;
+            }
+            queueCondition.notify_all();
+
+            for (auto &worker : workers)
+            {
+                worker.join();
+            }
+        }
+
+        /**
+         * Queue task for one of the threads
+         * @param task is callable without arguments
+         * @return future with result of task
+         */
+        template<class F>
+        std::future<typename std::result_of<F()>::type> submit(F task)
+        {
+            typedef typename std::result_of<F()>::type Result;
+
+            auto packagedTask = std::make_shared<std::packaged_task<Result()>>(task);
+            std::future<Result> result = packagedTask->get_future();
+            {
+                std::lock_guard<std::mutex> lock(queueMutex);
+                tasks.emplace_back([packagedTask] { (*packagedTask)(); });
+            }
+            queueCondition.notify_one();
+
+            return result;
+        }
+
+    private:
+        void run()
+        {
+            for (;;)
+            {
+                std::function<void()> task;
+                {
+                    std::unique_lock<std::mutex> lock(queueMutex);
+                    queueCondition.wait(lock, [this] { return stopping || !tasks.empty(); });
+                    if (tasks.empty())
+                    {
+                        return;
+                    }
+                    task = std::move(tasks.front());
+                    tasks.pop_front();
+                }
+                task();
+            }
+        }
+    };
+
+    /**
+     * Striped reader-writer locks of modules and keys
+     */
+    class LockManager
+    {
+    public:
+        std::shared_timed_mutex moduleLocks[LOCK_STRIPES];
+        std::shared_timed_mutex keyLocks[LOCK_STRIPES];
+
+        static size_t stripe(const std::string &name)
+        {
+            return std::hash<std::string>()(name) % LOCK_STRIPES;
+        }
+    };
+
+    /**
+     * Locks held by one operation, they are always taken in the same order: module stripes in
+     * ascending order, then key stripe. Operation on a key holds its module and all parent modules
+     * shared, so exclusive lock of a module waits only for operations inside that module.
+     */
+    class ScopedLock
+    {
+    private:
+        std::vector<std::pair<std::shared_timed_mutex *, bool>> held;
+
+        void acquire(std::shared_timed_mutex &lock, bool exclusive)
+        {
+            if (exclusive)
+            {
+                lock.lock();
+            } else
+            {
+                lock.lock_shared();
+            }
+            held.emplace_back(&lock, exclusive);
+        }
+
+        void acquireModule(LockManager &manager, const std::string &module, bool exclusive)
+        {
+            std::map<size_t, bool> stripes;
+            std::string normalized = normalizeModule(module);
+
+            stripes[LockManager::stripe("")] = false;
+            for (size_t pos = normalized.find('/'); pos != std::string::npos; pos = normalized.find('/', pos + 1))
+            {
+                stripes[LockManager::stripe(normalized.substr(0, pos))] = false;
+            }
+            stripes[LockManager::stripe(normalized)] = exclusive;
+
+            for (auto &stripe : stripes)
+            {
+                acquire(manager.moduleLocks[stripe.first], stripe.second);
+            }
+        }
+
+    public:
+        /**
+         * Lock key in module
+         * @param manager is lock manager of storage
+         * @param module is path to module, empty for root
+         * @param dataKey is key to be locked
+         * @param exclusive is true for writers
+         */
+        ScopedLock(LockManager &manager, const std::string &module, const std::string &dataKey, bool exclusive)
+        {
+            acquireModule(manager, module, false);
+            acquire(manager.keyLocks[LockManager::stripe(normalizeModule(module) + '\0' + dataKey)], exclusive);
+        }
+
+        /**
+         * Lock whole module including its sub-modules
+         * @param manager is lock manager of storage
+         * @param module is path to module, empty for root
+         * @param exclusive is true for operations changing the module
+         */
+        ScopedLock(LockManager &manager, const std::string &module, bool exclusive)
+        {
+            acquireModule(manager, module, exclusive);
+        }
+
+        /**
+         * Lock every module
+         * @param manager is lock manager of storage
+         * @param exclusive is true for operations changing whole storage
+         */
+        ScopedLock(LockManager &manager, bool exclusive)
+        {
+            for (auto &lock : manager.moduleLocks)
+            {
+                acquire(lock, exclusive);
+            }
+        }
+
+        ~ScopedLock()
+        {
+            for (auto it = held.rbegin(); it != held.rend(); ++it)
+            {
+                if (it->second)
+                {
+                    it->first->unlock();
+                } else
+                {
+                    it->first->unlock_shared();
+                }
+            }
+        }
+    };
+
+    /**
+     * Node of module trie, edges are labeled by whole module names. Every node is a module of its own,
+     * because parents of a module are created with it and listed by getAllModules, so the trie has no
+     * bare single-child chains that path compression could merge.
+     */
+    struct ModuleNode
+    {
+        std::map<std::string, std::unique_ptr<ModuleNode>> children;
+        std::set<std::string> keys;
+    };
+
+    /**
+     * In-memory catalog of modules and keys, kept in sync by every operation changing the storage.
+     * Modules form a trie, so queries on a module cost only its depth plus size of the result.
+     */
+    class KeyIndex
+    {
+    private:
+        mutable std::shared_timed_mutex indexMutex;
+        ModuleNode root;
+        std::unordered_map<std::string, size_t> keyCounts;
+
+        /**
+         * Walk the trie along module path
+         * @param module is normalized path to module
+         * @param create is true if missing modules should be added
+         * @return node of module, nullptr if it does not exist
+         */
+        ModuleNode *findNode(const std::string &module, bool create)
+        {
+            ModuleNode *node = &root;
+            size_t begin = 0;
+            while (node != nullptr && begin < module.size())
+            {
+                size_t end = module.find('/', begin);
+                if (end == std::string::npos)
+                {
+                    end = module.size();
+                }
+
+                std::string name = module.substr(begin, end - begin);
+                auto child = node->children.find(name);
+                if (child != node->children.end())
+                {
+                    node = child->second.get();
+                } else if (create)
+                {
+                    node = (node->children[name] = std::unique_ptr<ModuleNode>(new ModuleNode())).get();
+                } else
+                {
+                    node = nullptr;
+                }
+                begin = end + 1;
+            }
+
+            return node;
+        }
+
+        const ModuleNode *findNode(const std::string &module) const
+        {
+            return const_cast<KeyIndex *>(this)->findNode(module, false);
+        }
+
+        void forgetKeys(const ModuleNode &node)
+        {
+            for (auto &key : node.keys)
+            {
+                if (--keyCounts[key] == 0)
+                {
+                    keyCounts.erase(key);
+                }
+            }
+            for (auto &child : node.children)
+            {
+                forgetKeys(*child.second);
+            }
+        }
+
+        template<class F>
+        static void visitKeys(const ModuleNode &node, const std::string &module, bool recursive, F &function)
+        {
+            for (auto &key : node.keys)
+            {
+                function(module, key);
+            }
+            if (recursive)
+            {
+                for (auto &child : node.children)
+                {
+                    visitKeys(*child.second, module.empty() ? child.first : module + "/" + child.first,
+                              true, function);
+                }
+            }
+        }
+
+        template<class F>
+        static void visitModules(const ModuleNode &node, const std::string &module, F &function)
+        {
+            for (auto &child : node.children)
+            {
+                std::string childModule = module.empty() ? child.first : module + "/" + child.first;
+                function(childModule);
+                visitModules(*child.second, childModule, function);
+            }
+        }
+
+        static void collect(const ModuleNode &node, const std::string &module, const std::vector<std::string> *after,
+                            size_t depth, const std::string &afterKey, size_t limit,
+                            std::vector<std::pair<std::string, std::string>> &entries)
+        {
+            // Last listed key lies deeper, so keys of this node were listed already
+            bool onPath = after != nullptr && depth < after->size();
+
+            if (!onPath)
+            {
+                auto key = after != nullptr ? node.keys.upper_bound(afterKey) : node.keys.begin();
+                for (; key != node.keys.end() && entries.size() < limit; ++key)
+                {
+                    entries.emplace_back(module, *key);
+                }
+            }
+
+            auto child = onPath ? node.children.lower_bound((*after)[depth]) : node.children.begin();
+            for (; child != node.children.end() && entries.size() < limit; ++child)
+            {
+                bool continuesPath = onPath && child->first == (*after)[depth];
+                collect(*child->second, module.empty() ? child->first : module + "/" + child->first,
+                        continuesPath ? after : nullptr, depth + 1, afterKey, limit, entries);
+            }
+        }
+
+    public:
+        /**
+         * Add module and all its parents
+         * @param module is normalized path to module
+         */
+        void addModule(const std::string &module)
+        {
+            std::lock_guard<std::shared_timed_mutex> lock(indexMutex);
+            findNode(module, true);
+        }
+
+        /**
+         * Add key to module
+         * @param module is normalized path to module
+         * @param key is name of key
+         */
+        void addKey(const std::string &module, const std::string &key)
+        {
+            std::lock_guard<std::shared_timed_mutex> lock(indexMutex);
+            if (findNode(module, true)->keys.insert(key).second)
+            {
+                keyCounts[key]++;
+            }
+        }
+
+        /**
+         * Remove key from module
+         * @param module is normalized path to module
+         * @param key is name of key
+         */
+        void removeKey(const std::string &module, const std::string &key)
+        {
+            std::lock_guard<std::shared_timed_mutex> lock(indexMutex);
+            ModuleNode *node = findNode(module, false);
+            if (node != nullptr && node->keys.erase(key) != 0 && --keyCounts[key] == 0)
+            {
+                keyCounts.erase(key);
+            }
+        }
+
+        /**
+         * Remove module with all its keys and sub-modules
+         * @param module is normalized path to module
+         */
+        void removeModule(const std::string &module)
+        {
+            if (module.empty())
+            {
+                clear();
+                return;
+            }
+
+            std::lock_guard<std::shared_timed_mutex> lock(indexMutex);
+            size_t separator = module.rfind('/');
+            ModuleNode *parent = separator == std::string::npos ? &root : findNode(module.substr(0, separator), false);
+            if (parent == nullptr)
+            {
+                return;
+            }
+
+            auto found = parent->children.find(module.substr(separator == std::string::npos ? 0 : separator + 1));
+            if (found != parent->children.end())
+            {
+                forgetKeys(*found->second);
+                parent->children.erase(found);
+            }
+        }
+
+        /**
+         * Forget everything
+         */
+        void clear()
+        {
+            std::lock_guard<std::shared_timed_mutex> lock(indexMutex);
+            root.children.clear();
+            root.keys.clear();
+            keyCounts.clear();
+        }
+
+        /**
+         * Check if key exists in any module
+         * @param key is name of key
+         * @return true if key exists
+         */
+        bool containsKey(const std::string &key) const
+        {
+            std::shared_lock<std::shared_timed_mutex> lock(indexMutex);
+            return keyCounts.count(key) != 0;
+        }
+
+        /**
+         * Check if key exists in module
+         * @param module is normalized path to module
+         * @param key is name of key
+         * @return true if key exists
+         */
+        bool containsKey(const std::string &module, const std::string &key) const
+        {
+            std::shared_lock<std::shared_timed_mutex> lock(indexMutex);
+            const ModuleNode *node = findNode(module);
+            return node != nullptr && node->keys.count(key) != 0;
+        }
+
+        /**
+         * Call function for keys of module
+         * @param module is normalized path to module
+         * @param recursive is true if keys of sub-modules should be visited too
+         * @param function is called with module and key
+         */
+        template<class F>
+        void forEachKey(const std::string &module, bool recursive, F function) const
+        {
+            std::shared_lock<std::shared_timed_mutex> lock(indexMutex);
+            const ModuleNode *node = findNode(module);
+            if (node != nullptr)
+            {
+                visitKeys(*node, module, recursive, function);
+            }
+        }
+
+        /**
+         * Call function for every sub-module of module
+         * @param module is normalized path to module
+         * @param function is called with module
+         */
+        template<class F>
+        void forEachModule(const std::string &module, F function) const
+        {
+            std::shared_lock<std::shared_timed_mutex> lock(indexMutex);
+            const ModuleNode *node = findNode(module);
+            if (node != nullptr)
+            {
+                visitModules(*node, module, function);
+            }
+        }
+
+        /**
+         * Collect keys of module and its sub-modules in listing order, which is keys of a module
+         * followed by its sub-modules, both sorted by name
+         * @param module is normalized path to module
+         * @param after is path of modules of the last listed key relative to module, nullptr to start
+         * @param afterKey is name of the last listed key
+         * @param limit is maximal number of entries
+         * @param entries is vector where module and key pairs will be appended
+         */
+        void page(const std::string &module, const std::vector<std::string> *after, const std::string &afterKey,
+                  size_t limit, std::vector<std::pair<std::string, std::string>> &entries) const
+        {
+            std::shared_lock<std::shared_timed_mutex> lock(indexMutex);
+            const ModuleNode *node = findNode(module);
+            if (node != nullptr)
+            {
+                collect(*node, module, after, 0, afterKey, limit, entries);
+            }
+        }
+
+        /**
+         * Walk all PISSD folders and index modules and key files found in any of them
+         * @param rootPaths is array of paths to PISSD folders
+         */
+        void rebuild(const std::string rootPaths[])
+        {
+            clear();
+            for (int i = 0; i < 3; ++i)
+            {
+                boost::system::error_code error;
+                boost::filesystem::recursive_directory_iterator it(rootPaths[i], error), eod;
+                if (error)
+                {
+                    continue;
+                }
+                std::string rootPath = boost::filesystem::path(rootPaths[i]).generic_string();
+
+                for (; it != eod; ++it)
+                {
+                    boost::filesystem::path const &p = it->path();
+                    std::string fileName = p.filename().string();
+                    if (is_directory(p) && fileName == SEGMENT_DIRECTORY)
+                    {
+                        it.no_push();
+                    } else if (is_directory(p))
+                    {
+                        addModule(normalizeModule(p.generic_string().substr(rootPath.size())));
+                    } else if (is_regular_file(p) && fileName.size() > 5 && fileName.front() == '.'
+                               && fileName.compare(fileName.size() - 4, 4, ".jkl") == 0)
+                    {
+                        addKey(normalizeModule(p.parent_path().generic_string().substr(rootPath.size())),
+                               stripExtension(fileName));
+                    }
+                }
+            }
+        }
+    };
+
+    /**
+     * Catalog of modules and keys persisted in every PISSD folder, so opening does not walk the folders.
+     * Snapshot is replaced atomically by rename, changes made since are appended to journal whose records
+     * are checksummed one by one. Journal belongs to snapshot of the same generation only.
+     */
+    class Manifest
+    {
+    private:
+        SyncGroup &syncGroup;
+        std::mutex journalMutex;
+        std::string rootPaths[3];
+        std::ofstream journals[3];
+        uint64_t generation;
+        size_t journalRecords;
+
+        /**
+         * Header of snapshot or journal
+         * @param magic is magic of file
+         * @return header as string
+         */
+        std::string header(const char *magic) const
+        {
+            return std::string(magic) + (char) MANIFEST_VERSION + encodeValue(0, generation, 8).substr(1);
+        }
+
+        /**
+         * Apply one entry to index
+         */
+        static void apply(KeyIndex &index, char type, const std::string &module, const std::string &key)
+        {
+            switch (type)
+            {
+                case MANIFEST_ADD_KEY:
+                    index.addKey(module, key);
+                    break;
+                case MANIFEST_REMOVE_KEY:
+                    index.removeKey(module, key);
+                    break;
+                case MANIFEST_ADD_MODULE:
+                    index.addModule(module);
+                    break;
+                case MANIFEST_REMOVE_MODULE:
+                    index.removeModule(module);
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        /**
+         * Load snapshot and journal of one PISSD folder
+         * @param rootPath is path to PISSD folder
+         * @param index is index that will be filled
+         * @param replayed is number of replayed journal records, -1 if journal does not match snapshot
+         * @return false if snapshot is missing, fails verification or is older than journal
+         */
+        bool loadRoot(const std::string &rootPath, KeyIndex &index, long &replayed)
+        {
+            std::string data, journal, module, key;
+            std::vector<std::pair<char, std::pair<std::string, std::string>>> entries;
+            char type;
+
+            if (!readWholeFile(rootPath + "/" MANIFEST_FILE, data)
+                || data.size() < MANIFEST_HEADER_SIZE + CryptoPP::SHA256::DIGESTSIZE
+                || data.compare(0, 3, MANIFEST_MAGIC) != 0 || data[3] != MANIFEST_VERSION)
+            {
+                return false;
+            }
+
+            size_t end = data.size() - CryptoPP::SHA256::DIGESTSIZE;
+            CryptoPP::SHA256 hash;
+            if (!hash.VerifyDigest((const CryptoPP::byte *) data.data() + end, (const CryptoPP::byte *) data.data(),
+                                   end))
+            {
+                return false;
+            }
+
+            for (size_t position = MANIFEST_HEADER_SIZE; position < end;)
+            {
+                if (!decodeManifestEntry(data, position, type, module, key) || position > end)
+                {
+                    return false;
+                }
+                entries.emplace_back(type, std::make_pair(module, key));
+            }
+
+            // Journal older than snapshot is already folded in, newer one follows snapshot that never reached disk
+            bool hasJournal = readWholeFile(rootPath + "/" MANIFEST_JOURNAL_FILE, journal)
+                              && journal.size() >= MANIFEST_HEADER_SIZE
+                              && journal.compare(0, 3, MANIFEST_JOURNAL_MAGIC) == 0
+                              && journal[3] == MANIFEST_VERSION;
+            if (hasJournal && decodeValue(journal.substr(4, 8)) > decodeValue(data.substr(4, 8)))
+            {
+                return false;
+            }
+
+            generation = decodeValue(data.substr(4, 8));
+            index.clear();
+            for (auto &entry : entries)
+            {
+                apply(index, entry.first, entry.second.first, entry.second.second);
+            }
+
+            // Torn tail of journal is what crash left behind, records before it are valid
+            replayed = -1;
+            if (hasJournal && journal.compare(0, MANIFEST_HEADER_SIZE, header(MANIFEST_JOURNAL_MAGIC)) == 0)
+            {
+                replayed = 0;
+                size_t begin = MANIFEST_HEADER_SIZE, position = begin;
+                while (decodeManifestEntry(journal, position, type, module, key)
+                       && journal.size() - position >= CryptoPP::CRC32::DIGESTSIZE)
+                {
+                    CryptoPP::CRC32 crc;
+                    if (!crc.VerifyDigest((const CryptoPP::byte *) journal.data() + position,
+                                          (const CryptoPP::byte *) journal.data() + begin, position - begin))
+                    {
+                        break;
+                    }
+                    apply(index, type, module, key);
+                    replayed++;
+                    position += CryptoPP::CRC32::DIGESTSIZE;
+                    begin = position;
+                }
+            }
+
+            return true;
+        }
+
+        /**
+         * Write snapshot of index to every PISSD folder and start empty journals, caller holds journalMutex.
+         * Folders are locked by RootSet, so no other process appends to journals being truncated.
+         * @param index is current index
+         */
+        void writeSnapshot(const KeyIndex &index)
+        {
+            generation++;
+            std::string data = header(MANIFEST_MAGIC);
+            index.forEachModule("", [&](const std::string &module)
+            {
+                data += encodeManifestEntry(MANIFEST_ADD_MODULE, module, "");
+            });
+            index.forEachKey("", true, [&](const std::string &module, const std::string &key)
+            {
+                data += encodeManifestEntry(MANIFEST_ADD_KEY, module, key);
+            });
+
+            CryptoPP::byte digest[CryptoPP::SHA256::DIGESTSIZE];
+            CryptoPP::SHA256().CalculateDigest(digest, (const CryptoPP::byte *) data.data(), data.size());
+            data.append((const char *) digest, sizeof(digest));
+
+            for (int i = 0; i < 3; ++i)
+            {
+                std::string path = rootPaths[i] + "/" MANIFEST_FILE;
+                std::ofstream outFile(path + ".tmp", std::ios::out | std::ios::binary | std::ios::trunc);
+                outFile << data;
+                outFile.close();
+
+                // Snapshot reaches disk before journal is truncated, journal of newer generation makes folder unusable
+                boost::system::error_code error;
+                if (outFile && syncPath(path + ".tmp", true))
+                {
+                    boost::filesystem::rename(path + ".tmp", path, error);
+                    syncPath(rootPaths[i], false);
+                }
+
+                journals[i].close();
+                journals[i].clear();
+                journals[i].open(rootPaths[i] + "/" MANIFEST_JOURNAL_FILE,
+                                 std::ios::out | std::ios::binary | std::ios::trunc);
+                journals[i] << header(MANIFEST_JOURNAL_MAGIC);
+                journals[i].flush();
+            }
+            journalRecords = 0;
+        }
+
+    public:
+        explicit Manifest(SyncGroup &group) : syncGroup(group), generation(0), journalRecords(0)
+        {
+        }
+
+        /**
+         * Load index from the first PISSD folder whose manifest verifies, stale manifests are rewritten
+         * @param roots is array of paths to PISSD folders
+         * @param index is index that will be filled
+         * @return false if no manifest can be used and folders have to be scanned
+         */
+        bool load(const std::string roots[], KeyIndex &index)
+        {
+            std::lock_guard<std::mutex> lock(journalMutex);
+            for (int i = 0; i < 3; ++i)
+            {
+                rootPaths[i] = roots[i];
+            }
+
+            for (int i = 0; i < 3; ++i)
+            {
+                long replayed;
+                if (loadRoot(rootPaths[i], index, replayed))
+                {
+                    if (i != 0 || replayed != 0)
+                    {
+                        writeSnapshot(index);
+                        return true;
+                    }
+
+                    for (int j = 0; j < 3; ++j)
+                    {
+                        journals[j].open(rootPaths[j] + "/" MANIFEST_JOURNAL_FILE,
+                                         std::ios::out | std::ios::binary | std::ios::app);
+                    }
+                    return true;
+                }
+            }
+            index.clear();
+
+            return false;
+        }
+
+        /**
+         * Replace manifest by snapshot of index, it is used after folders were scanned
+         * @param index is current index
+         */
+        void snapshot(const KeyIndex &index)
+        {
+            std::lock_guard<std::mutex> lock(journalMutex);
+            writeSnapshot(index);
+        }
+
+        /**
+         * Fold journal into snapshot if it grew too long, caller must exclude every other change
+         * @param index is current index
+         */
+        void compact(const KeyIndex &index)
+        {
+            std::lock_guard<std::mutex> lock(journalMutex);
+            if (journalRecords >= MANIFEST_JOURNAL_LIMIT)
+            {
+                writeSnapshot(index);
+            }
+        }
+
+        /**
+         * Append change to journal of every PISSD folder
+         * @param type is type of change
+         * @param module is normalized path to module
+         * @param key is name of key, empty for module changes
+         * @param sync is true if record has to reach disk before return
+         * @return true if journal should be compacted
+         */
+        bool log(char type, const std::string &module, const std::string &key, bool sync)
+        {
+            std::string record = encodeManifestEntry(type, module, key);
+            CryptoPP::byte checksum[CryptoPP::CRC32::DIGESTSIZE];
+            CryptoPP::CRC32().CalculateDigest(checksum, (const CryptoPP::byte *) record.data(), record.size());
+            record.append((const char *) checksum, sizeof(checksum));
+
+            std::vector<SyncTarget> targets;
+            bool compact;
+            {
+                std::lock_guard<std::mutex> lock(journalMutex);
+                for (int i = 0; i < 3; ++i)
+                {
+                    journals[i] << record;
+                    journals[i].flush();
+                    if (journals[i])
+                    {
+                        targets.push_back({rootPaths[i], rootPaths[i] + "/" MANIFEST_JOURNAL_FILE, true});
+                    }
+                }
+                compact = ++journalRecords >= MANIFEST_JOURNAL_LIMIT;
+            }
+
+            if (sync && !targets.empty())
+            {
+                syncGroup.sync(targets);
+            }
+
+            return compact;
+        }
+
+        /**
+         * Forget journals after PISSD folders were removed, folders will be scanned on next open
+         */
+        void reset()
+        {
+            std::lock_guard<std::mutex> lock(journalMutex);
+            for (auto &journal : journals)
+            {
+                journal.close();
+                journal.clear();
+            }
+            journalRecords = 0;
+        }
+    };
+
+    /**
+     * Place where replicas of records are kept, every PISSD folder holds one replica.
+     * Modules are passed normalized, callers hold lock of the key or module.
+     */
+    class ReplicaStore
+    {
+    protected:
+        SyncGroup &syncGroup;
+
+        /**
+         * Save record to one replica, it is called from lane of the replica
+         * @param replica is index of PISSD folder
+         * @param durability is what has to reach disk before replica counts as written
+         * @return false if replica was not written
+         */
+        virtual bool writeReplica(int replica, const std::string &module, const std::string &key,
+                                  const std::string &record, Durability durability) = 0;
+
+        /**
+         * Load record from one replica
+         * @param replica is index of PISSD folder
+         * @param data is string where record will be stored, it stays empty if replica has no record
+         * @return false if replica has no record
+         */
+        virtual bool readReplica(int replica, const std::string &module, const std::string &key,
+                                 std::string &data) = 0;
+
+    private:
+        struct ReadTracker
+        {
+            std::atomic<uint64_t> latency{0};
+            std::atomic<uint64_t> reads{0};
+            std::atomic<uint64_t> slowReads{0};
+            std::atomic<uint64_t> hedgedReads{0};
+        };
+
+        struct Reading
+        {
+            std::mutex readingMutex;
+            std::condition_variable readingCondition;
+            std::string data;
+            std::atomic<bool> started{false};
+            bool done = false;
+        };
+
+        std::unique_ptr<WorkerPool> readers;
+        ReadTracker trackers[3];
+        std::atomic<uint64_t> readCounter;
+        std::mutex readMutex;
+        std::condition_variable readCondition;
+        size_t readsRunning;
+        std::unique_ptr<WorkerPool> lanes[3];
+        std::atomic<size_t> backlog[3];
+        std::mutex repairMutex;
+        std::map<std::string, unsigned> repairs;
+        std::mutex writingMutex;
+        std::map<std::string, unsigned> writing;
+
+        /**
+         * Remember result of replica write, failed replica waits for repair until it is written again
+         */
+        void settle(int replica, const std::string &module, const std::string &key, bool written)
+        {
+            if (written && pendingRepairs == 0)
+            {
+                return;
+            }
+
+            std::lock_guard<std::mutex> lock(repairMutex);
+            std::string name = module + '\0' + key;
+            if (!written)
+            {
+                failedWrites++;
+                repairs[name] |= 1u << replica;
+            } else
+            {
+                auto repair = repairs.find(name);
+                if (repair != repairs.end() && (repair->second &= ~(1u << replica)) == 0)
+                {
+                    repairs.erase(repair);
+                }
+            }
+            pendingRepairs = repairs.size();
+        }
+
+        /**
+         * Read one replica and fold time it took into moving average of its latency
+         */
+        bool timedRead(int replica, const std::string &module, const std::string &key, std::string &data)
+        {
+            auto start = std::chrono::steady_clock::now();
+            bool found = readReplica(replica, module, key, data);
+            uint64_t sample = std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - start).count();
+
+            ReadTracker &tracker = trackers[replica];
+            uint64_t average = tracker.latency;
+            uint64_t updated;
+            do
+            {
+                updated = average == 0 ? sample : average - average / LATENCY_WEIGHT + sample / LATENCY_WEIGHT;
+            } while (!tracker.latency.compare_exchange_weak(average, updated));
+            tracker.reads++;
+
+            return found;
+        }
+
+        /**
+         * Read one replica by pool
+         * @param replica is index of PISSD folder
+         * @return read that is done once record is loaded
+         */
+        std::shared_ptr<Reading> startRead(int replica, const std::string &module, const std::string &key)
+        {
+            auto reading = std::make_shared<Reading>();
+            {
+                std::lock_guard<std::mutex> lock(readMutex);
+                readsRunning++;
+            }
+            readers->submit([this, reading, replica, module, key]
+            {
+                std::string record;
+                reading->started = true;
+                timedRead(replica, module, key, record);
+                {
+                    std::lock_guard<std::mutex> lock(reading->readingMutex);
+                    reading->data.swap(record);
+                    reading->done = true;
+                    reading->readingCondition.notify_all();
+                }
+
+                std::lock_guard<std::mutex> lock(readMutex);
+                if (--readsRunning == 0)
+                {
+                    readCondition.notify_all();
+                }
+            });
+
+            return reading;
+        }
+
+        /**
+         * Wait for read started by startRead
+         * @param until is deadline of read, nullptr waits as long as read takes
+         * @param data is string where record will be stored
+         * @return false if read missed deadline, data is left alone then
+         */
+        static bool awaitRead(Reading &reading, const std::chrono::steady_clock::time_point *until,
+                              std::string &data)
+        {
+            std::unique_lock<std::mutex> lock(reading.readingMutex);
+            if (until)
+            {
+                if (!reading.readingCondition.wait_until(lock, *until, [&reading] { return reading.done; }))
+                {
+                    return false;
+                }
+            } else
+            {
+                reading.readingCondition.wait(lock, [&reading] { return reading.done; });
+            }
+            data.swap(reading.data);
+
+            return true;
+        }
+
+        /**
+         * Replica missed deadline, its average is raised so the next reads prefer other replicas
+         * until it answers again
+         */
+        void penalize(int replica, uint64_t deadline)
+        {
+            ReadTracker &tracker = trackers[replica];
+            uint64_t average = tracker.latency;
+            while (average < deadline && !tracker.latency.compare_exchange_weak(average, deadline));
+            tracker.slowReads++;
+        }
+
+    public:
+        std::atomic<uint64_t> failedWrites;
+        std::atomic<size_t> pendingRepairs;
+        std::atomic<uint64_t> repairedReplicas;
+
+        explicit ReplicaStore(SyncGroup &group) : syncGroup(group), readers(new WorkerPool(READERPOOL_SIZE)),
+                                                  readCounter(0), readsRunning(0), failedWrites(0), pendingRepairs(0),
+                                                  repairedReplicas(0)
+        {
+            for (int i = 0; i < 3; ++i)
+            {
+                lanes[i].reset(new WorkerPool(1));
+                backlog[i] = 0;
+            }
+        }
+
+        virtual ~ReplicaStore()
+        {
+        }
+
+        /**
+         * Statistics of reads of one replica
+         */
+        ReplicaStats getReplicaStats(int replica)
+        {
+            ReplicaStats stats;
+            stats.latencyMicroseconds = trackers[replica].latency;
+            stats.reads = trackers[replica].reads;
+            stats.slowReads = trackers[replica].slowReads;
+            stats.hedgedReads = trackers[replica].hedgedReads;
+
+            return stats;
+        }
+
+        /**
+         * Prepare store, it is called once when storage is opened
+         * @param roots is array of paths to PISSD folders
+         */
+        virtual void open(const std::string roots[]) = 0;
+
+        /**
+         * Save record to all replicas at once. Every replica has its own lane that writes records in order
+         * they were submitted, so record finishing in background is never written over a newer one.
+         * Replicas that fail are remembered for repair.
+         * @param durability is what has to reach disk before replica counts as written
+         * @param quorum is number of replicas write waits for, the others finish in background
+         * @return number of replicas written when quorum was reached or all replicas finished
+         */
+        int write(const std::string &module, const std::string &key, const std::string &record,
+                  Durability durability, int quorum)
+        {
+            struct Progress
+            {
+                std::mutex progressMutex;
+                std::condition_variable progressCondition;
+                int written = 0;
+                int finished = 0;
+            };
+
+            auto progress = std::make_shared<Progress>();
+            auto shared = std::make_shared<const std::string>(record);
+            std::string name = module + '\0' + key;
+            {
+                std::lock_guard<std::mutex> lock(writingMutex);
+                writing[name] += 3;
+            }
+            for (auto &pending : backlog)
+            {
+                // Lane of slow disk must not fall behind without limit, so writes wait for it once it lags
+                if (pending > FANOUT_BACKLOG)
+                {
+                    quorum = 3;
+                }
+            }
+
+            for (int i = 0; i < 3; ++i)
+            {
+                backlog[i]++;
+                lanes[i]->submit([this, i, module, key, name, shared, durability, progress]
+                {
+                    bool written = writeReplica(i, module, key, *shared, durability);
+                    settle(i, module, key, written);
+                    backlog[i]--;
+                    {
+                        std::lock_guard<std::mutex> lock(writingMutex);
+                        auto pending = writing.find(name);
+                        if (--pending->second == 0)
+                        {
+                            writing.erase(pending);
+                        }
+                    }
+
+                    std::lock_guard<std::mutex> lock(progress->progressMutex);
+                    progress->written += written ? 1 : 0;
+                    progress->finished++;
+                    progress->progressCondition.notify_all();
+                });
+            }
+
+            std::unique_lock<std::mutex> lock(progress->progressMutex);
+            progress->progressCondition.wait(lock, [&]
+            {
+                return progress->written >= quorum || progress->finished == 3;
+            });
+
+            return progress->written;
+        }
+
+        /**
+         * Check if write of key is still finishing in background, its replicas may differ until it is done
+         * @return true if some replica of key is not written yet
+         */
+        bool isWriting(const std::string &module, const std::string &key)
+        {
+            std::lock_guard<std::mutex> lock(writingMutex);
+
+            return writing.count(module + '\0' + key) != 0;
+        }
+
+        /**
+         * Read record from every replica, reads are not counted into latency of replicas
+         * @param data is array of records, replicas without record are left empty
+         */
+        void readAll(const std::string &module, const std::string &key, std::string data[])
+        {
+            for (int i = 0; i < 3; ++i)
+            {
+                readReplica(i, module, key, data[i]);
+            }
+        }
+
+        /**
+         * Rewrite replicas that differ from record in background. Lane of each replica rewrites it only if
+         * it still holds what reader found, so repair never lands over a newer record.
+         * @param record is record agreed by majority of replicas
+         * @param seen is array of records reader found
+         * @param loaded is array of flags of replicas that were read, the others are left alone
+         * @param durability is what has to reach disk before replica counts as repaired
+         * @return number of replicas scheduled for repair
+         */
+        int repair(const std::string &module, const std::string &key, const std::string &record,
+                   const std::string seen[], const bool loaded[], Durability durability)
+        {
+            auto shared = std::make_shared<const std::string>(record);
+            int scheduled = 0;
+            for (int i = 0; i < 3; ++i)
+            {
+                if (!loaded[i] || seen[i] == record)
+                {
+                    continue;
+                }
+
+                std::string expected = seen[i];
+                backlog[i]++;
+                lanes[i]->submit([this, i, module, key, shared, expected, durability]
+                {
+                    std::string current;
+                    readReplica(i, module, key, current);
+                    if (current == expected)
+                    {
+                        bool written = writeReplica(i, module, key, *shared, durability);
+                        settle(i, module, key, written);
+                        if (written)
+                        {
+                            repairedReplicas++;
+                        }
+                    }
+                    backlog[i]--;
+                });
+                scheduled++;
+            }
+
+            return scheduled;
+        }
+
+        /**
+         * Wait until writes finishing in background are done, callers do it before removing replicas
+         */
+        void drain()
+        {
+            std::future<void> done[3];
+            for (int i = 0; i < 3; ++i)
+            {
+                done[i] = lanes[i]->submit([] {});
+            }
+            for (auto &lane : done)
+            {
+                lane.get();
+            }
+        }
+
+        /**
+         * Wait until reads abandoned by hedging are done, they use store so it cannot go away before
+         */
+        void awaitAbandonedReads()
+        {
+            std::unique_lock<std::mutex> lock(readMutex);
+            readCondition.wait(lock, [this] { return readsRunning == 0; });
+        }
+
+        /**
+         * Forget pending repairs of removed key, or of removed module and its sub-modules if key is empty
+         */
+        void forgetRepairs(const std::string &module, const std::string &key)
+        {
+            std::lock_guard<std::mutex> lock(repairMutex);
+            if (!key.empty())
+            {
+                repairs.erase(module + '\0' + key);
+            } else if (module.empty())
+            {
+                repairs.clear();
+            } else
+            {
+                std::string prefixes[2] = {module + '\0', module + "/"};
+                for (auto &prefix : prefixes)
+                {
+                    auto repair = repairs.lower_bound(prefix);
+                    while (repair != repairs.end() && repair->first.compare(0, prefix.size(), prefix) == 0)
+                    {
+                        repair = repairs.erase(repair);
+                    }
+                }
+            }
+            pendingRepairs = repairs.size();
+        }
+
+        /**
+         * Read record from the two replicas with the lowest average latency at once. The third replica
+         * is read only if they differ, one of them has no record or either of them misses deadline.
+         * Every few reads the slowest replica takes part instead, so its average stays current.
+         * @param data is array of records, replicas that were not read or have no record are left empty
+         * @param loaded is array of flags of replicas that were read
+         * @param deadline is how long read waits for the two fastest replicas in microseconds, zero reads
+         *                 all replicas every time
+         * @return 2 if no replica was found, 1 if only one was found, 0 otherwise
+         */
+        int read(const std::string &module, const std::string &key, std::string data[], bool loaded[],
+                 uint32_t deadline)
+        {
+            uint64_t latency[3];
+            int order[3] = {0, 1, 2};
+            for (int i = 0; i < 3; ++i)
+            {
+                latency[i] = trackers[i].latency;
+                loaded[i] = false;
+                data[i].clear();
+            }
+            std::sort(order, order + 3, [&latency](int a, int b)
+            {
+                return latency[a] < latency[b] || (latency[a] == latency[b] && a < b);
+            });
+            if (++readCounter % HEDGE_PROBE_INTERVAL == 0)
+            {
+                std::swap(order[1], order[2]);
+            }
+
+            if (deadline == 0)
+            {
+                for (int i = 0; i < 3; ++i)
+                {
+                    loaded[i] = true;
+                    timedRead(i, module, key, data[i]);
+                }
+            } else
+            {
+                // Both fastest replicas are read by pool, either may outlive this call if it misses deadline
+                std::shared_ptr<Reading> readings[2] = {startRead(order[0], module, key),
+                                                        startRead(order[1], module, key)};
+                auto until = std::chrono::steady_clock::now() + std::chrono::microseconds(deadline);
+                bool late[2];
+                for (int i = 0; i < 2; ++i)
+                {
+                    late[i] = !awaitRead(*readings[i], &until, data[order[i]]);
+                    loaded[order[i]] = !late[i];
+                    if (late[i] && readings[i]->started)
+                    {
+                        penalize(order[i], deadline);
+                    }
+                }
+
+                if (late[0] || late[1] || data[order[0]].empty() || data[order[0]] != data[order[1]])
+                {
+                    trackers[order[2]].hedgedReads++;
+                    loaded[order[2]] = true;
+                    timedRead(order[2], module, key, data[order[2]]);
+
+                    // Late replica is still needed when the replicas that answered do not agree
+                    for (int i = 0; i < 2; ++i)
+                    {
+                        if (late[i] && findQuorum(data) < 0)
+                        {
+                            awaitRead(*readings[i], nullptr, data[order[i]]);
+                            loaded[order[i]] = true;
+                        }
+                    }
+                }
+            }
+
+            int emptyCounter = 0;
+            for (int i = 0; i < 3; ++i)
+            {
+                if (data[i].empty())
+                {
+                    emptyCounter++;
+                }
+            }
+
+            return emptyCounter == 3 ? 2 : (emptyCounter == 2 ? 1 : 0);
+        }
+
+        /**
+         * Remove record from all replicas
+         * @param durability is what has to reach disk before removal counts as done
+         */
+        virtual void remove(const std::string &module, const std::string &key, Durability durability) = 0;
+
+        /**
+         * Remove records of module and its sub-modules, folders of module are removed by caller
+         * @param durability is what has to reach disk before removal counts as done
+         */
+        virtual void removeModule(const std::string &module, Durability durability) = 0;
+
+        /**
+         * Forget everything after PISSD folders were removed
+         */
+        virtual void reset() = 0;
+
+        /**
+         * Call function for every key held by store that is not visible as file in PISSD folders
+         */
+        virtual void forEachKey(const std::function<void(const std::string &, const std::string &)> &function) = 0;
+
+        /**
+         * Take over key stored as files in PISSD folders
+         * @param durability is what has to reach disk before files of key are removed
+         * @return non-zero value if key was imported
+         */
+        virtual int import(const std::string &module, const std::string &key, Durability durability) = 0;
+
+        /**
+         * Configure reclaiming of space taken by dead records, stores without dead records ignore it
+         */
+        virtual void setCompactionPolicy(const CompactionPolicy &policy)
+        {
+        }
+
+        /**
+         * Statistics of reclaiming space taken by dead records
+         */
+        virtual CompactionStats getCompactionStats()
+        {
+            return CompactionStats();
+        }
+    };
+
+    /**
+     * Every key is a hidden file in each PISSD folder
+     */
+    class FileStore : public ReplicaStore
+    {
+    private:
+        std::string rootPaths[3];
+
+    public:
+        explicit FileStore(SyncGroup &group) : ReplicaStore(group)
+        {
+        }
+
+        void open(const std::string roots[]) override
+        {
+            for (int i = 0; i < 3; ++i)
+            {
+                rootPaths[i] = roots[i];
+            }
+        }
+
+    protected:
+        bool writeReplica(int replica, const std::string &module, const std::string &key,
+                          const std::string &record, Durability durability) override
+        {
+#ifdef PISSD_IO_URING
+            UringQueue &queue = uringQueue();
+            if (queue.ready)
+            {
+                return uringCreateFile(queue, rootPaths, replica, module, key, record, durability, syncGroup);
+            }
+#endif
+            return createFile(rootPaths, replica, module, key, record, durability, syncGroup);
+        }
+
+        bool readReplica(int replica, const std::string &module, const std::string &key, std::string &data) override
+        {
+#ifdef PISSD_IO_URING
+            UringQueue &queue = uringQueue();
+            if (queue.ready)
+            {
+                return uringLoadFile(queue, rootPaths, replica, module, data, key);
+            }
+#endif
+            return loadFile(rootPaths, replica, module, data, key);
+        }
+
+    public:
+
+        void remove(const std::string &module, const std::string &key, Durability durability) override
+        {
+            std::string pathsToFile[3] = {rootPaths[0], rootPaths[1], rootPaths[2]};
+            if (!module.empty())
+            {
+                addModuleToPath(module, pathsToFile);
+            }
+
+            std::vector<SyncTarget> targets;
+            for (int i = 0; i < 3; ++i)
+            {
+                std::string path = pathsToFile[i] + "/." + key + ".jkl";
+#ifdef WIN32
+                DeleteFile(path.c_str());
+#endif
+#if defined(__APPLE__) || defined(__linux__)
+                std::remove(path.c_str());
+#endif
+                if (durability == Durability::DirectorySync)
+                {
+                    targets.push_back({rootPaths[i], pathsToFile[i], false});
+                }
+            }
+
+            // Removal is durable only once folder that held the replica is synced
+            if (!targets.empty())
+            {
+                syncGroup.sync(targets);
+            }
+        }
+
+        void removeModule(const std::string &module, Durability durability) override
+        {
+            if (durability != Durability::DirectorySync || module.empty())
+            {
+                return;
+            }
+
+            // Records lived in folders of module, so their removal is durable once parent folders are synced
+            std::string pathsToModule[3] = {rootPaths[0], rootPaths[1], rootPaths[2]};
+            addModuleToPath(module, pathsToModule);
+            std::vector<SyncTarget> targets;
+            for (int i = 0; i < 3; ++i)
+            {
+                targets.push_back({rootPaths[i], boost::filesystem::path(pathsToModule[i]).parent_path().string(),
+                                   false});
+            }
+            syncGroup.sync(targets);
+        }
+
+        void reset() override
+        {
+        }
+
+        void forEachKey(const std::function<void(const std::string &, const std::string &)> &function) override
+        {
+        }
+
+        int import(const std::string &module, const std::string &key, Durability durability) override
+        {
+            return 0;
+        }
+    };
+
+    /**
+     * Position of value inside segment
+     */
+    struct SegmentLocation
+    {
+        uint64_t segment;
+        uint64_t offset;
+        uint32_t length;
+        uint32_t recordSize;
+    };
+
+    /**
+     * Append-only file of records
+     */
+    struct Segment
+    {
+        std::string path;
+        std::ifstream reader;
+        uint64_t size;
+        uint64_t liveBytes;
+        uint64_t tombstoneBytes;
+
+        explicit Segment(const std::string &path) : path(path), size(0), liveBytes(0), tombstoneBytes(0)
+        {
+        }
+    };
+
+    /**
+     * Every PISSD folder holds append-only segments of records and their index is kept in memory.
+     * Record is type, module, key and value, all but type prefixed by length, followed by CRC32 of record.
+     * Sealed segments get hint file with locations of their records, so open does not read values.
+     * Background compactor rewrites sealed segments full of dead records in place, so replay order is kept.
+     */
+    class SegmentStore : public ReplicaStore
+    {
+    private:
+        struct Replica
+        {
+            std::mutex replicaMutex;
+            std::string root;
+            std::string directory;
+            std::map<uint64_t, std::unique_ptr<Segment>> segments;
+            std::map<std::string, SegmentLocation> locations;
+            std::ofstream writer;
+            uint64_t activeSegment = 0;
+            uint64_t epoch = 0;
+            std::string hint;
+        };
+
+        std::string rootPaths[3];
+        Replica replicas[3];
+        std::atomic<uint64_t> segmentSize;
+
+        std::mutex compactorMutex;
+        std::condition_variable compactorCondition;
+        std::thread compactor;
+        bool stopping;
+        CompactionPolicy policy;
+        std::atomic<uint64_t> reclaimedBytes;
+        std::atomic<uint64_t> compactedBytes;
+        std::atomic<uint64_t> segmentsCompacted;
+        std::atomic<uint64_t> busyMicroseconds;
+
+        static std::string locationKey(const std::string &module, const std::string &key)
+        {
+            return module + '\0' + key;
+        }
+
+        static std::string segmentPath(const Replica &replica, uint64_t id, const std::string &extension)
+        {
+            std::string number = std::to_string(id);
+            return replica.directory + "/segment-" + std::string(number.size() < 8 ? 8 - number.size() : 0, '0')
+                   + number + extension;
+        }
+
+        /**
+         * Forget location of key, its record becomes dead
+         */
+        static void forget(Replica &replica, std::map<std::string, SegmentLocation>::iterator location)
+        {
+            replica.segments[location->second.segment]->liveBytes -= location->second.recordSize;
+            replica.locations.erase(location);
+        }
+
+        /**
+         * Forget locations of all keys in module and its sub-modules
+         */
+        static void forgetModule(Replica &replica, const std::string &module)
+        {
+            if (module.empty())
+            {
+                while (!replica.locations.empty())
+                {
+                    forget(replica, replica.locations.begin());
+                }
+                return;
+            }
+
+            std::string prefixes[2] = {locationKey(module, ""), module + "/"};
+            for (auto &prefix : prefixes)
+            {
+                auto location = replica.locations.lower_bound(prefix);
+                while (location != replica.locations.end() && location->first.compare(0, prefix.size(), prefix) == 0)
+                {
+                    forget(replica, location++);
+                }
+            }
+        }
+
+        /**
+         * Apply record to index of replica and remember it for hint of segment
+         */
+        static void apply(Replica &replica, uint64_t segment, char type, const std::string &module,
+                          const std::string &key, uint64_t offset, uint32_t length, uint32_t recordSize)
+        {
+            auto location = replica.locations.find(locationKey(module, key));
+            switch (type)
+            {
+                case SEGMENT_PUT:
+                    if (location != replica.locations.end())
+                    {
+                        forget(replica, location);
+                    }
+                    replica.locations[locationKey(module, key)] = {segment, offset, length, recordSize};
+                    replica.segments[segment]->liveBytes += recordSize;
+                    break;
+                case SEGMENT_DELETE:
+                    if (location != replica.locations.end())
+                    {
+                        forget(replica, location);
+                    }
+                    replica.segments[segment]->tombstoneBytes += recordSize;
+                    break;
+                case SEGMENT_REMOVE_MODULE:
+                    forgetModule(replica, module);
+                    replica.segments[segment]->tombstoneBytes += recordSize;
+                    break;
+                default:
+                    break;
+            }
+
+            replica.hint += encodeManifestEntry(type, module, key) + encodeValue(0, offset, 8).substr(1)
+                            + encodeValue(0, length, 4).substr(1) + encodeValue(0, recordSize, 4).substr(1);
+        }
+
+        /**
+         * Load locations of sealed segment from its hint file
+         * @return false if hint is missing or fails verification
+         */
+        static bool loadHint(Replica &replica, uint64_t id)
+        {
+            std::string data, module, key;
+            std::vector<std::pair<std::string, std::string>> names;
+            std::vector<char> types;
+            std::vector<std::string> positions;
+            char type;
+
+            if (!readWholeFile(segmentPath(replica, id, ".hint"), data) || data.size() < CryptoPP::SHA256::DIGESTSIZE)
+            {
+                return false;
+            }
+
+            size_t end = data.size() - CryptoPP::SHA256::DIGESTSIZE;
+            CryptoPP::SHA256 hash;
+            if (!hash.VerifyDigest((const CryptoPP::byte *) data.data() + end, (const CryptoPP::byte *) data.data(),
+                                   end))
+            {
+                return false;
+            }
+
+            for (size_t position = 0; position < end; position += 16)
+            {
+                if (!decodeManifestEntry(data, position, type, module, key) || end - position < 16)
+                {
+                    return false;
+                }
+                types.push_back(type);
+                names.emplace_back(module, key);
+                positions.push_back(data.substr(position, 16));
+            }
+
+            for (size_t i = 0; i < types.size(); ++i)
+            {
+                apply(replica, id, types[i], names[i].first, names[i].second, decodeValue(positions[i].substr(0, 8)),
+                      (uint32_t) decodeValue(positions[i].substr(8, 4)),
+                      (uint32_t) decodeValue(positions[i].substr(12, 4)));
+            }
+            replica.segments[id]->size = boost::filesystem::file_size(replica.segments[id]->path);
+
+            return true;
+        }
+
+        /**
+         * Parse record at position and verify its checksum
+         * @param data is content of segment
+         * @param position is offset of record, it is moved behind the record
+         * @param valueOffset is offset of value of record
+         * @param length is length of value
+         * @return false if record is truncated or damaged
+         */
+        static bool parseRecord(const std::string &data, size_t &position, char &type, std::string &module,
+                                std::string &key, size_t &valueOffset, uint32_t &length)
+        {
+            size_t begin = position;
+            size_t offset = position;
+            if (!decodeManifestEntry(data, offset, type, module, key) || data.size() - offset < 4)
+            {
+                return false;
+            }
+
+            length = (uint32_t) decodeValue(data.substr(offset, 4));
+            offset += 4;
+            CryptoPP::CRC32 crc;
+            if (data.size() - offset < (uint64_t) length + CryptoPP::CRC32::DIGESTSIZE
+                || !crc.VerifyDigest((const CryptoPP::byte *) data.data() + offset + length,
+                                     (const CryptoPP::byte *) data.data() + begin, offset + length - begin))
+            {
+                return false;
+            }
+
+            valueOffset = offset;
+            position = offset + length + CryptoPP::CRC32::DIGESTSIZE;
+
+            return true;
+        }
+
+        /**
+         * Read records of segment one by one until the first damaged one
+         * @param truncate is true if damaged tail should be cut off, so appends continue after valid records
+         */
+        static void scanSegment(Replica &replica, uint64_t id, bool truncate)
+        {
+            std::string data, module, key;
+            char type;
+            size_t position = 0, valueOffset;
+            uint32_t length;
+
+            readWholeFile(replica.segments[id]->path, data);
+            for (size_t begin = 0; parseRecord(data, position, type, module, key, valueOffset, length);
+                 begin = position)
+            {
+                apply(replica, id, type, module, key, valueOffset, length, (uint32_t) (position - begin));
+            }
+
+            replica.segments[id]->size = position;
+            if (truncate && position < data.size())
+            {
+                boost::system::error_code error;
+                boost::filesystem::resize_file(replica.segments[id]->path, position, error);
+            }
+        }
+
+        /**
+         * Load all segments of replica in order they were written
+         */
+        static void load(Replica &replica)
+        {
+            std::vector<uint64_t> ids;
+            boost::system::error_code error;
+            boost::filesystem::directory_iterator it(replica.directory, error), end;
+
+            for (; !error && it != end; it.increment(error))
+            {
+                std::string name = it->path().filename().string();
+                if (name.size() == 20 && name.compare(0, 8, "segment-") == 0 && name.compare(16, 4, ".dat") == 0
+                    && std::all_of(name.begin() + 8, name.begin() + 16, ::isdigit))
+                {
+                    ids.push_back(std::stoull(name.substr(8, 8)));
+                }
+            }
+            std::sort(ids.begin(), ids.end());
+
+            for (auto id : ids)
+            {
+                replica.segments[id] = std::unique_ptr<Segment>(new Segment(segmentPath(replica, id, ".dat")));
+                replica.hint.clear();
+                if (id == ids.back() || !loadHint(replica, id))
+                {
+                    scanSegment(replica, id, id == ids.back());
+                }
+            }
+
+            if (!ids.empty())
+            {
+                replica.activeSegment = ids.back();
+                replica.writer.open(replica.segments[ids.back()]->path,
+                                    std::ios::out | std::ios::binary | std::ios::app);
+            }
+        }
+
+        /**
+         * Write hint file of segment, it is replaced by rename so it is either old or new one
+         * @param hint is serialized locations of records in segment
+         */
+        static void writeHint(const Replica &replica, uint64_t id, std::string hint)
+        {
+            CryptoPP::byte digest[CryptoPP::SHA256::DIGESTSIZE];
+            CryptoPP::SHA256().CalculateDigest(digest, (const CryptoPP::byte *) hint.data(), hint.size());
+            hint.append((const char *) digest, sizeof(digest));
+
+            std::string path = segmentPath(replica, id, ".hint");
+            std::ofstream hintFile(path + ".tmp", std::ios::out | std::ios::binary | std::ios::trunc);
+            hintFile << hint;
+            hintFile.close();
+
+            boost::system::error_code error;
+            if (hintFile)
+            {
+                boost::filesystem::rename(path + ".tmp", path, error);
+            }
+        }
+
+        /**
+         * Seal active segment with hint file and start a new one, caller holds replicaMutex
+         * @return false if segment cannot be created
+         */
+        static bool roll(Replica &replica)
+        {
+            boost::system::error_code error;
+            if (replica.writer.is_open() || !replica.segments.empty())
+            {
+                replica.writer.close();
+                writeHint(replica, replica.activeSegment, replica.hint);
+            }
+
+            uint64_t id = replica.segments.empty() ? 0 : replica.segments.rbegin()->first + 1;
+            boost::filesystem::create_directories(replica.directory, error);
+            if (!boost::filesystem::exists(replica.directory + "/" SEGMENT_MARKER, error))
+            {
+                // Root is claimed before first record, imported files are removed only after that
+                std::ofstream marker(replica.directory + "/" SEGMENT_MARKER, std::ios::out | std::ios::trunc);
+                marker << "segments\n";
+                if (!marker.flush())
+                {
+                    return false;
+                }
+            }
+            replica.writer.clear();
+            replica.writer.open(segmentPath(replica, id, ".dat"), std::ios::out | std::ios::binary | std::ios::app);
+            if (!replica.writer.is_open())
+            {
+                return false;
+            }
+
+            replica.segments[id] = std::unique_ptr<Segment>(new Segment(segmentPath(replica, id, ".dat")));
+            replica.activeSegment = id;
+            replica.hint.clear();
+
+            return true;
+        }
+
+        /**
+         * Append record to active segment, caller holds replicaMutex and flushes targets after releasing it
+         * @param durability is what has to reach disk before record counts as written
+         * @param targets is vector where files and folders that have to reach disk are added
+         * @return false if record was not written
+         */
+        bool append(Replica &replica, char type, const std::string &module, const std::string &key,
+                    const std::string &value, Durability durability, std::vector<SyncTarget> &targets)
+        {
+            std::string record = encodeManifestEntry(type, module, key) + encodeValue(0, value.size(), 4).substr(1);
+            size_t valueOffset = record.size();
+            record += value;
+
+            CryptoPP::byte checksum[CryptoPP::CRC32::DIGESTSIZE];
+            CryptoPP::CRC32().CalculateDigest(checksum, (const CryptoPP::byte *) record.data(), record.size());
+            record.append((const char *) checksum, sizeof(checksum));
+
+            bool rolled = false;
+            if (!replica.writer.is_open() || replica.segments[replica.activeSegment]->size >= segmentSize)
+            {
+                if (!roll(replica))
+                {
+                    return false;
+                }
+                rolled = true;
+                compactorCondition.notify_one();
+            }
+
+            Segment &segment = *replica.segments[replica.activeSegment];
+            replica.writer.write(record.data(), record.size());
+            replica.writer.flush();
+            if (!replica.writer)
+            {
+                // Partial record is cut off and the next append starts a new segment
+                boost::system::error_code error;
+                replica.writer.close();
+                boost::filesystem::resize_file(segment.path, segment.size, error);
+                return false;
+            }
+
+            apply(replica, replica.activeSegment, type, module, key, segment.size + valueOffset,
+                  (uint32_t) value.size(), (uint32_t) record.size());
+            segment.size += record.size();
+
+            // Appends only grow the segment, so its folder needs syncing just when a segment is created
+            if (durability != Durability::None)
+            {
+                targets.push_back({replica.root, segment.path, true});
+            }
+            if (rolled && durability == Durability::DirectorySync)
+            {
+                targets.push_back({replica.root, replica.directory, false});
+            }
+
+            return true;
+        }
+
+        /**
+         * Sleep so work done since start does not exceed rate of policy, store that is stopping wakes it
+         * @return false if store is stopping and compaction has to be abandoned
+         */
+        bool throttle(const CompactionPolicy &policy, std::chrono::steady_clock::time_point started,
+                      uint64_t processed)
+        {
+            std::unique_lock<std::mutex> lock(compactorMutex);
+            if (policy.bytesPerSecond > 0)
+            {
+                compactorCondition.wait_until(lock, started + std::chrono::microseconds(
+                        processed * 1000000 / policy.bytesPerSecond), [this] { return stopping; });
+            }
+
+            return !stopping;
+        }
+
+        /**
+         * Rewrite live records of one sealed segment with enough dead records, records are copied as they are
+         * and tombstones are kept while older segments may hold records they hide. Segment is parsed and
+         * verified without replicaMutex, it is taken only in short batches to check which records are live.
+         * @return true if segment was compacted
+         */
+        bool compactReplica(Replica &replica, const CompactionPolicy &policy)
+        {
+            uint64_t id = 0, epoch;
+            bool found = false, hasOlder = false;
+            std::string path;
+            {
+                std::lock_guard<std::mutex> lock(replica.replicaMutex);
+                for (auto &segment : replica.segments)
+                {
+                    hasOlder = segment.first != replica.segments.begin()->first;
+                    uint64_t dead = segment.second->size - segment.second->liveBytes
+                                    - (hasOlder ? segment.second->tombstoneBytes : 0);
+                    if (segment.first != replica.activeSegment && dead > 0
+                        && dead >= policy.deadRatio * segment.second->size)
+                    {
+                        id = segment.first;
+                        found = true;
+                        break;
+                    }
+                }
+                if (!found)
+                {
+                    return false;
+                }
+                epoch = replica.epoch;
+                path = replica.segments[id]->path;
+            }
+
+            auto started = std::chrono::steady_clock::now();
+            uint64_t processed = 0;
+            std::string data, chunk(COMPACTION_CHUNK_SIZE, '\0');
+            std::ifstream inFile(path, std::ios::in | std::ios::binary);
+            while (inFile.read(&chunk[0], chunk.size()) || inFile.gcount() > 0)
+            {
+                data.append(chunk, 0, (size_t) inFile.gcount());
+                processed += inFile.gcount();
+                if (!throttle(policy, started, processed))
+                {
+                    return false;
+                }
+            }
+            inFile.close();
+
+            struct Parsed
+            {
+                char type;
+                std::string module, key;
+                size_t oldOffset, newOffset;
+                uint32_t length, recordSize;
+            };
+            std::vector<Parsed> records;
+            std::vector<size_t> begins;
+            std::string module, key;
+            char type;
+            size_t position = 0, valueOffset;
+            uint32_t length;
+            for (size_t begin = 0; parseRecord(data, position, type, module, key, valueOffset, length);
+                 begin = position)
+            {
+                records.push_back({type, module, key, valueOffset, 0, length, (uint32_t) (position - begin)});
+                begins.push_back(begin);
+            }
+
+            // Record that died stays dead, so liveness checked batch by batch is still valid for the copy
+            std::vector<bool> live(records.size(), false);
+            for (size_t first = 0; first < records.size(); first += COMPACTION_BATCH_SIZE)
+            {
+                std::lock_guard<std::mutex> lock(replica.replicaMutex);
+                if (replica.epoch != epoch)
+                {
+                    return false;
+                }
+
+                size_t last = std::min(records.size(), first + COMPACTION_BATCH_SIZE);
+                for (size_t i = first; i < last; ++i)
+                {
+                    auto location = replica.locations.find(locationKey(records[i].module, records[i].key));
+                    live[i] = records[i].type == SEGMENT_PUT && location != replica.locations.end()
+                              && location->second.segment == id && location->second.offset == records[i].oldOffset;
+                }
+            }
+
+            std::vector<Parsed> kept;
+            std::string output, hint;
+            uint64_t tombstoneBytes = 0;
+            for (size_t i = 0; i < records.size(); ++i)
+            {
+                if (live[i] || (records[i].type != SEGMENT_PUT && hasOlder))
+                {
+                    records[i].newOffset = output.size() + records[i].oldOffset - begins[i];
+                    output.append(data, begins[i], records[i].recordSize);
+                    tombstoneBytes += live[i] ? 0 : records[i].recordSize;
+                    kept.push_back(std::move(records[i]));
+                }
+            }
+
+            std::ofstream outFile(path + ".tmp", std::ios::out | std::ios::binary | std::ios::trunc);
+            bool copied = true;
+            for (size_t offset = 0; copied && offset < output.size(); offset += COMPACTION_CHUNK_SIZE)
+            {
+                size_t size = std::min((size_t) COMPACTION_CHUNK_SIZE, output.size() - offset);
+                outFile.write(output.data() + offset, size);
+                processed += size;
+                copied = throttle(policy, started, processed);
+            }
+            outFile.close();
+
+            boost::system::error_code error;
+            std::lock_guard<std::mutex> lock(replica.replicaMutex);
+            auto segment = replica.segments.find(id);
+            if (!copied || !outFile || replica.epoch != epoch || segment == replica.segments.end())
+            {
+                boost::filesystem::remove(path + ".tmp", error);
+                return false;
+            }
+
+            // Stale hint must not survive new layout of segment, missing one only makes open scan it
+            segment->second->reader.close();
+            boost::filesystem::remove(segmentPath(replica, id, ".hint"), error);
+            if (kept.empty())
+            {
+                boost::filesystem::remove(path + ".tmp", error);
+                boost::filesystem::remove(path, error);
+                reclaimedBytes += segment->second->size;
+                replica.segments.erase(segment);
+            } else
+            {
+                // Compacted segment replaces records that may have been written durably
+                syncPath(path + ".tmp", true);
+                boost::filesystem::rename(path + ".tmp", path, error);
+                if (error)
+                {
+                    boost::filesystem::remove(path + ".tmp", error);
+                    return false;
+                }
+
+                // Records may have died while segment was copied, only those still pointing here move
+                uint64_t liveBytes = 0;
+                for (auto &record : kept)
+                {
+                    auto location = replica.locations.find(locationKey(record.module, record.key));
+                    if (record.type == SEGMENT_PUT && location != replica.locations.end()
+                        && location->second.segment == id && location->second.offset == record.oldOffset)
+                    {
+                        location->second.offset = record.newOffset;
+                        liveBytes += record.recordSize;
+                    }
+                    hint += encodeManifestEntry(record.type, record.module, record.key)
+                            + encodeValue(0, record.newOffset, 8).substr(1) + encodeValue(0, record.length, 4).substr(1)
+                            + encodeValue(0, record.recordSize, 4).substr(1);
+                }
+
+                reclaimedBytes += segment->second->size - output.size();
+                segment->second->size = output.size();
+                segment->second->liveBytes = liveBytes;
+                segment->second->tombstoneBytes = tombstoneBytes;
+                writeHint(replica, id, hint);
+            }
+
+            syncPath(replica.directory, false);
+
+            compactedBytes += processed;
+            segmentsCompacted++;
+            busyMicroseconds += std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - started).count();
+
+            return true;
+        }
+
+        /**
+         * Compact replicas until no segment qualifies, then wait for new sealed segments
+         */
+        void runCompactor()
+        {
+            std::unique_lock<std::mutex> lock(compactorMutex);
+            while (!stopping)
+            {
+                CompactionPolicy current = policy;
+                lock.unlock();
+                bool compacted = false;
+                for (auto &replica : replicas)
+                {
+                    compacted = compactReplica(replica, current) || compacted;
+                }
+                lock.lock();
+
+                if (!compacted && !stopping)
+                {
+                    compactorCondition.wait_for(lock, std::chrono::seconds(COMPACTION_INTERVAL));
+                }
+            }
+        }
+
+    public:
+        explicit SegmentStore(SyncGroup &group) : ReplicaStore(group), segmentSize(SEGMENT_MAX_SIZE), stopping(false), reclaimedBytes(0), compactedBytes(0),
+                         segmentsCompacted(0), busyMicroseconds(0)
+        {
+        }
+
+        ~SegmentStore() override
+        {
+            {
+                std::lock_guard<std::mutex> lock(compactorMutex);
+                stopping = true;
+            }
+            compactorCondition.notify_all();
+            if (compactor.joinable())
+            {
+                compactor.join();
+            }
+        }
+
+        /**
+         * Check if segment engine already holds records of roots, their key files were moved into segments
+         * @param roots are paths of replica roots
+         * @return true if any root carries marker of segment engine
+         */
+        static bool owns(const std::string roots[])
+        {
+            boost::system::error_code error;
+            for (int i = 0; i < 3; ++i)
+            {
+                if (boost::filesystem::exists(roots[i] + "/" SEGMENT_DIRECTORY "/" SEGMENT_MARKER, error))
+                {
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        void open(const std::string roots[]) override
+        {
+            for (int i = 0; i < 3; ++i)
+            {
+                std::lock_guard<std::mutex> lock(replicas[i].replicaMutex);
+                rootPaths[i] = roots[i];
+                replicas[i].root = roots[i];
+                replicas[i].directory = roots[i] + "/" SEGMENT_DIRECTORY;
+                load(replicas[i]);
+            }
+
+            compactor = std::thread(&SegmentStore::runCompactor, this);
+        }
+
+    protected:
+        bool writeReplica(int replica, const std::string &module, const std::string &key,
+                          const std::string &record, Durability durability) override
+        {
+            std::vector<SyncTarget> targets;
+            bool written;
+            {
+                std::lock_guard<std::mutex> lock(replicas[replica].replicaMutex);
+                written = append(replicas[replica], SEGMENT_PUT, module, key, record, durability, targets);
+            }
+
+            return written && (targets.empty() || syncGroup.sync(targets));
+        }
+
+        bool readReplica(int index, const std::string &module, const std::string &key, std::string &data) override
+        {
+            Replica &replica = replicas[index];
+            std::lock_guard<std::mutex> lock(replica.replicaMutex);
+            data.clear();
+            auto location = replica.locations.find(locationKey(module, key));
+            if (location != replica.locations.end() && location->second.length > 0)
+            {
+                Segment &segment = *replica.segments[location->second.segment];
+                if (!segment.reader.is_open())
+                {
+                    segment.reader.open(segment.path, std::ios::in | std::ios::binary);
+                }
+                segment.reader.clear();
+                segment.reader.seekg(location->second.offset);
+                data.resize(location->second.length);
+                segment.reader.read(&data[0], location->second.length);
+                if (!segment.reader)
+                {
+                    data.clear();
+                }
+            }
+
+            return !data.empty();
+        }
+
+    public:
+
+        void remove(const std::string &module, const std::string &key, Durability durability) override
+        {
+            std::vector<SyncTarget> targets;
+            for (auto &replica : replicas)
+            {
+                std::lock_guard<std::mutex> lock(replica.replicaMutex);
+                if (replica.locations.count(locationKey(module, key)) != 0)
+                {
+                    append(replica, SEGMENT_DELETE, module, key, "", durability, targets);
+                }
+            }
+
+            if (!targets.empty())
+            {
+                syncGroup.sync(targets);
+            }
+        }
+
+        void removeModule(const std::string &module, Durability durability) override
+        {
+            std::vector<SyncTarget> targets;
+            for (auto &replica : replicas)
+            {
+                std::lock_guard<std::mutex> lock(replica.replicaMutex);
+                append(replica, SEGMENT_REMOVE_MODULE, module, "", "", durability, targets);
+            }
+
+            if (!targets.empty())
+            {
+                syncGroup.sync(targets);
+            }
+        }
+
+        void reset() override
+        {
+            for (auto &replica : replicas)
+            {
+                std::lock_guard<std::mutex> lock(replica.replicaMutex);
+                replica.writer.close();
+                replica.writer.clear();
+                replica.segments.clear();
+                replica.locations.clear();
+                replica.activeSegment = 0;
+                replica.epoch++;
+                replica.hint.clear();
+            }
+        }
+
+        void forEachKey(const std::function<void(const std::string &, const std::string &)> &function) override
+        {
+            for (auto &replica : replicas)
+            {
+                std::lock_guard<std::mutex> lock(replica.replicaMutex);
+                for (auto &location : replica.locations)
+                {
+                    size_t separator = location.first.find('\0');
+                    function(location.first.substr(0, separator), location.first.substr(separator + 1));
+                }
+            }
+        }
+
+        int import(const std::string &module, const std::string &key, Durability durability) override
+        {
+            std::string data[3];
+            for (auto &replica : replicas)
+            {
+                std::lock_guard<std::mutex> lock(replica.replicaMutex);
+                if (replica.locations.count(locationKey(module, key)) != 0)
+                {
+                    return 0;
+                }
+            }
+
+            bool found = false;
+            for (int i = 0; i < 3; ++i)
+            {
+                found = loadFile(rootPaths, i, module, data[i], key) || found;
+            }
+            if (!found)
+            {
+                return 0;
+            }
+
+            // Replicas are copied as they are, so divergent ones stay divergent
+            std::string pathsToFile[3] = {rootPaths[0], rootPaths[1], rootPaths[2]};
+            if (!module.empty())
+            {
+                addModuleToPath(module, pathsToFile);
+            }
+            std::vector<SyncTarget> targets;
+            bool appended[3];
+            for (int i = 0; i < 3; ++i)
+            {
+                std::lock_guard<std::mutex> lock(replicas[i].replicaMutex);
+                appended[i] = data[i].empty()
+                              || append(replicas[i], SEGMENT_PUT, module, key, data[i], durability, targets);
+            }
+
+            // Files are removed only when their copies are as durable as configured
+            bool synced = targets.empty() || syncGroup.sync(targets);
+            for (int i = 0; i < 3; ++i)
+            {
+                if (appended[i] && synced)
+                {
+                    boost::system::error_code error;
+                    boost::filesystem::remove(pathsToFile[i] + "/." + key + ".jkl", error);
+                }
+            }
+
+            return 1;
+        }
+
+        void setCompactionPolicy(const CompactionPolicy &newPolicy) override
+        {
+            {
+                std::lock_guard<std::mutex> lock(compactorMutex);
+                policy = newPolicy;
+            }
+            segmentSize = newPolicy.segmentSize;
+            compactorCondition.notify_one();
+        }
+
+        CompactionStats getCompactionStats() override
+        {
+            CompactionStats stats;
+            for (auto &replica : replicas)
+            {
+                std::lock_guard<std::mutex> lock(replica.replicaMutex);
+                for (auto &segment : replica.segments)
+                {
+                    stats.liveBytes += segment.second->liveBytes;
+                    stats.totalBytes += segment.second->size;
+                }
+            }
+
+            stats.spaceAmplification = stats.liveBytes > 0 ? (double) stats.totalBytes / stats.liveBytes : 0;
+            stats.reclaimedBytes = reclaimedBytes;
+            stats.compactedBytes = compactedBytes;
+            stats.segmentsCompacted = segmentsCompacted;
+            uint64_t busy = busyMicroseconds;
+            stats.throughput = busy > 0 ? (double) stats.compactedBytes * 1000000 / busy : 0;
+
+            return stats;
+        }
+    };
+
+    /**
+     * State of background scrubber, its thread runs SecureDataStorage::runScrubber. Reads of scrubber are
+     * paced by budget of policy, time spent paused or resting between passes does not count into it.
+     */
+    class Scrubber
+    {
+    private:
+        std::mutex scrubberMutex;
+        std::condition_variable scrubberCondition;
+        std::thread worker;
+        ScrubPolicy policy;
+        ScrubProgress progress;
+        bool stopping;
+        std::chrono::steady_clock::time_point windowStart;
+        uint64_t windowBytes;
+
+    public:
+        Scrubber() : stopping(false), windowBytes(0)
+        {
+        }
+
+        ~Scrubber()
+        {
+            stop();
+        }
+
+        /**
+         * Start thread or only replace policy if it runs already
+         * @param newPolicy is policy of scrubbing
+         * @param run is body of thread
+         */
+        void start(const ScrubPolicy &newPolicy, const std::function<void()> &run)
+        {
+            std::lock_guard<std::mutex> lock(scrubberMutex);
+            policy = newPolicy;
+            if (!progress.running && !stopping)
+            {
+                progress.running = true;
+                worker = std::thread(run);
+            }
+            scrubberCondition.notify_all();
+        }
+
+        /**
+         * Stop thread, it finishes key it is checking
+         */
+        void stop()
+        {
+            {
+                std::lock_guard<std::mutex> lock(scrubberMutex);
+                stopping = true;
+            }
+            scrubberCondition.notify_all();
+            if (worker.joinable())
+            {
+                worker.join();
+            }
+        }
+
+        void pause(bool paused)
+        {
+            std::lock_guard<std::mutex> lock(scrubberMutex);
+            progress.paused = paused;
+            scrubberCondition.notify_all();
+        }
+
+        ScrubProgress getProgress()
+        {
+            std::lock_guard<std::mutex> lock(scrubberMutex);
+            return progress;
+        }
+
+        /**
+         * Start new pass over all keys
+         * @param keys is number of keys pass walks
+         */
+        void beginPass(size_t keys)
+        {
+            std::lock_guard<std::mutex> lock(scrubberMutex);
+            progress.keysScrubbed = 0;
+            progress.keysTotal = keys;
+            windowStart = std::chrono::steady_clock::now();
+            windowBytes = 0;
+        }
+
+        /**
+         * Wait while scrubber is paused or ahead of its budget
+         * @return false if scrubber is stopping
+         */
+        bool proceed()
+        {
+            std::unique_lock<std::mutex> lock(scrubberMutex);
+            while (!stopping)
+            {
+                if (progress.paused)
+                {
+                    scrubberCondition.wait(lock);
+                    windowStart = std::chrono::steady_clock::now();
+                    windowBytes = 0;
+                    continue;
+                }
+
+                auto until = windowStart + std::chrono::microseconds(
+                        policy.bytesPerSecond > 0 ? windowBytes * 1000000 / policy.bytesPerSecond : 0);
+                if (std::chrono::steady_clock::now() >= until)
+                {
+                    return true;
+                }
+                scrubberCondition.wait_until(lock, until);
+            }
+
+            return false;
+        }
+
+        /**
+         * Count checked key
+         * @param result is 0 if replicas agree, 1 if they were repaired, 2 if they have no majority
+         * @param bytes is number of bytes read
+         */
+        void account(int result, uint64_t bytes)
+        {
+            std::lock_guard<std::mutex> lock(scrubberMutex);
+            windowBytes += bytes;
+            progress.bytesScrubbed += bytes;
+            progress.keysScrubbed++;
+            if (result == 1)
+            {
+                progress.divergentKeys++;
+                progress.repairedKeys++;
+            } else if (result == 2)
+            {
+                progress.divergentKeys++;
+                progress.unrepairableKeys++;
+            }
+        }
+
+        /**
+         * Finish pass and wait for the next one
+         * @return false if scrubber is stopping
+         */
+        bool rest()
+        {
+            std::unique_lock<std::mutex> lock(scrubberMutex);
+            progress.passes++;
+            auto until = std::chrono::steady_clock::now() + std::chrono::seconds(policy.intervalSeconds);
+            scrubberCondition.wait_until(lock, until, [this] { return stopping; });
+
+            return !stopping;
+        }
+    };
+
+    /**
+     * State of one set of PISSD folders shared by every instance of the process that uses them, so their
+     * locks, catalog, manifest, replica lanes and workers stay one. Registry keeps it while some instance
+     * holds it. Folders are locked against other processes, so this state is the only one.
+     */
+    class RootSet
+    {
+    private:
+        std::mutex openMutex;
+        bool opened;
+        bool locked;
+
+    public:
+        std::string rootPaths[3];
+        StorageEngine engine;
+        SyncGroup syncGroup;
+        LockManager lockManager;
+        KeyIndex keyIndex;
+        Manifest manifest;
+        std::unique_ptr<ReplicaStore> replicaStore;
+        std::unique_ptr<WorkerPool> workerPool;
+        std::atomic<bool> rootsCreated;
+
+        explicit RootSet(StorageEngine engine)
+                : opened(false), locked(false), engine(engine), manifest(syncGroup),
+                  replicaStore(engine == StorageEngine::Segments ? (ReplicaStore *) new SegmentStore(syncGroup)
+                                                                 : new FileStore(syncGroup)),
+                  workerPool(new WorkerPool(WORKERPOOL_SIZE)), rootsCreated(false)
+        {
+        }
+
+        /**
+         * Finish writes and reads running in background before store goes away and unlock folders
+         */
+        ~RootSet()
+        {
+            replicaStore->drain();
+            replicaStore->awaitAbandonedReads();
+            workerPool.reset();
+            if (locked)
+            {
+                unlockFolders(rootPaths);
+            }
+        }
+
+        /**
+         * Find state of PISSD folders used by another instance or create new one
+         * @param roots is array of canonical paths to PISSD folders
+         * @param engine is layout of replicas
+         * @return state of folders, nullptr if some of them belong to other folders or another engine
+         */
+        static std::shared_ptr<RootSet> acquire(const std::string roots[], StorageEngine engine)
+        {
+            static std::mutex registryMutex;
+            static std::map<std::string, std::weak_ptr<RootSet>> registry;
+
+            std::lock_guard<std::mutex> lock(registryMutex);
+            for (auto entry = registry.begin(); entry != registry.end();)
+            {
+                entry = entry->second.expired() ? registry.erase(entry) : std::next(entry);
+            }
+
+            // Folder may take part in one set only, or replicas of two sets would collide in it
+            std::shared_ptr<RootSet> found[3];
+            for (int i = 0; i < 3; ++i)
+            {
+                auto entry = registry.find(roots[i]);
+                found[i] = entry != registry.end() ? entry->second.lock() : nullptr;
+            }
+            if (found[0] != found[1] || found[0] != found[2])
+            {
+                return nullptr;
+            }
+            if (found[0])
+            {
+                return found[0]->engine == engine ? found[0] : nullptr;
+            }
+
+            auto created = std::make_shared<RootSet>(engine);
+            for (int i = 0; i < 3; ++i)
+            {
+                created->rootPaths[i] = roots[i];
+                registry[roots[i]] = created;
+            }
+
+            return created;
+        }
+
+        /**
+         * Lock and create PISSD folders, prepare store and load catalog, it is done only by the first instance.
+         * Folders used by another process and roots already converted by segment engine are refused.
+         * Temporary replicas left by crashed processes are removed in background.
+         * @param durability is what has to reach disk before imported key files are removed
+         * @return non-zero value if error occurs
+         */
+        int open(Durability durability)
+        {
+            std::lock_guard<std::mutex> lock(openMutex);
+            if (opened)
+            {
+                return 0;
+            }
+
+            // Catalog, manifest and segments are kept in memory of one process, another one would diverge
+            if (!locked && !(locked = lockFolders(rootPaths)))
+            {
+                return -1;
+            }
+
+            // Segment engine moved key files into segments, file engine would list keys it cannot read
+            if (engine == StorageEngine::Files && SegmentStore::owns(rootPaths))
+            {
+                return -1;
+            }
+            createDirPath(rootPaths);
+            rootsCreated = true;
+            replicaStore->open(rootPaths);
+            if (!manifest.load(rootPaths, keyIndex))
+            {
+                keyIndex.rebuild(rootPaths);
+                replicaStore->forEachKey([this](const std::string &module, const std::string &key)
+                {
+                    keyIndex.addKey(module, key);
+                });
+                manifest.snapshot(keyIndex);
+            }
+
+            if (engine == StorageEngine::Segments)
+            {
+                std::vector<std::pair<std::string, std::string>> keys;
+                keyIndex.forEachKey("", true, [&](const std::string &module, const std::string &key)
+                {
+                    keys.emplace_back(module, key);
+                });
+                for (auto &key : keys)
+                {
+                    replicaStore->import(key.first, key.second, durability);
+                }
+            }
+            workerPool->submit([this] { removeStaleTempFiles(rootPaths); });
+            opened = true;
+
+            return 0;
+        }
+    };
+
+    /**
+     * Create instance of PISSD library
+     */
+    SecureDataStorage::SecureDataStorage() : SecureDataStorage(StorageEngine::Files)
+    {
+    }
+
+    /**
+     * Create instance of PISSD library
+     * @param engine is layout of replicas, keys stored as files are imported by segment engine
+     */
+    SecureDataStorage::SecureDataStorage(StorageEngine engine)
+            : masterKey(CryptoPP::SHA256::DIGESTSIZE), keyCache(new KeyCache(KEYCACHE_DEFAULT_SIZE)),
+              saltPool(new SaltPool()), scrubber(new Scrubber()),
+              engine(engine), durability(Durability::None), writeQuorum(WRITE_QUORUM_DEFAULT),
+              hedgeDeadline(HEDGE_DEADLINE), groupCommitSet(false), groupCommitBatch(SYNCGROUP_BATCH_SIZE),
+              groupCommitWindow(0), compactionPolicySet(false), opened(false), retrieveMisses(0)
+    {
+    }
+
+    /**
+     * Create instance of PISSD library
+     * @param mMutex is pointer to mutex, it is not used anymore because instances using the same folders
+     *               share their locks
+     */
+    SecureDataStorage::SecureDataStorage(std::mutex * mMutex) : SecureDataStorage()
+    {
+    }
+
+    /**
+     * Stop scrubber and wipe cached key material, writes running in background are finished by the last
+     * instance using the same folders
+     */
+    SecureDataStorage::~SecureDataStorage()
+    {
+        scrubber->stop();
+        keyCache->clear();
+    }
+
+    /**
+     * Resolve identity of user and device, find and create PISSD folders and derive master key.
+     * It is done only once, every other operation calls it implicitly. Instances using the same folders
+     * share their state, so they have to use the same engine.
+     * @return non-zero value if error occurs
+     */
+    int SecureDataStorage::open()
+    {
+        if (opened)
+        {
+            return 0;
+        }
+
+        std::lock_guard<std::mutex> lock(openMutex);
+        if (opened)
+        {
+            return 0;
+        }
+
+        identity = getUsername() + getUUID();
+        std::string roots[3];
+        if (pinnedRootPaths.empty())
+        {
+            getDirPath(roots);
+        } else
+        {
+            std::copy(pinnedRootPaths.begin(), pinnedRootPaths.end(), roots);
+        }
+        for (auto &root : roots)
+        {
+            root = canonicalRoot(root);
+        }
+
+        // Replicas sharing one folder would overwrite each other, default folders can collide through XDG paths
+        if (roots[0] == roots[1] || roots[0] == roots[2] || roots[1] == roots[2])
+        {
+            return -1;
+        }
+
+        std::shared_ptr<RootSet> set = RootSet::acquire(roots, engine);
+        if (!set || set->open(durability) != 0)
+        {
+            return -1;
+        }
+        std::copy(set->rootPaths, set->rootPaths + 3, rootPaths);
+        if (groupCommitSet)
+        {
+            set->syncGroup.configure(groupCommitBatch, std::chrono::microseconds(groupCommitWindow));
+        }
+        if (compactionPolicySet)
+        {
+            set->replicaStore->setCompactionPolicy(compactionPolicy);
+        }
+        initializeMasterKey(identity, masterKey);
+
+        shared = set;
+        opened = true;
+
+        return 0;
+    }
+
+    /**
+     * Place PISSD folders to caller chosen directories instead of default ones, e.g. on separate disks.
+     * It has to be called before storage is opened.
+     * @param paths is vector of three paths to folders of replicas, they have to resolve to distinct folders
+     * @return non-zero value if storage is already opened or paths are not valid
+     */
+    int SecureDataStorage::setRootPaths(const std::vector<std::string> &paths)
+    {
+        std::lock_guard<std::mutex> lock(openMutex);
+        if (opened || paths.size() != 3 || paths[0].empty() || paths[1].empty() || paths[2].empty())
+        {
+            return -1;
+        }
+
+        std::string roots[3] = {canonicalRoot(paths[0]), canonicalRoot(paths[1]), canonicalRoot(paths[2])};
+        if (roots[0] == roots[1] || roots[0] == roots[2] || roots[1] == roots[2])
+        {
+            return -1;
+        }
+        pinnedRootPaths = paths;
+
+        return 0;
+    }
+
+    /**
+     * Copy resolved paths of PISSD folders
+     * @param paths is array of string where paths will be stored
+     * @return non-zero value if storage cannot be opened
+     */
+    int SecureDataStorage::getRootPaths(std::string paths[])
+    {
+        if (open() != 0)
+        {
+            return -1;
+        }
+        for (int i = 0; i < 3; ++i)
+        {
+            paths[i] = rootPaths[i];
+        }
+
+        return 0;
+    }
+
+    /**
+     * Create PISSD folders again if they were removed by deleteAllData
+     */
+    void SecureDataStorage::ensureRootDirs()
+    {
+        if (!shared->rootsCreated)
+        {
+            createDirPath(rootPaths);
+            shared->rootsCreated = true;
+        }
+    }
+
+    /**
+     * Fold journal of manifest into new snapshot while no other operation changes storage
+     */
+    void SecureDataStorage::compactManifest()
+    {
+        ScopedLock lock(shared->lockManager, true);
+        shared->manifest.compact(shared->keyIndex);
+    }
+
+    /**
+     * Set maximal number of dataKeys whose key material is kept in memory
+     * @param entries is number of cached keys, zero disables the cache
+     */
+    void SecureDataStorage::setKeyCacheSize(size_t entries)
+    {
+        keyCache->resize(entries);
+    }
+
+    /**
+     * Number of operations that found key material in cache
+     * @return count of hits
+     */
+    uint64_t SecureDataStorage::getKeyCacheHits() const
+    {
+        return keyCache->hits;
+    }
+
+    /**
+     * Number of operations that had to derive key material
+     * @return count of misses
+     */
+    uint64_t SecureDataStorage::getKeyCacheMisses() const
+    {
+        return keyCache->misses;
+    }
+
+    /**
+     * Set what has to reach disk before store, delete and module operations report success
+     * @param level is durability level, Durability::None by default
+     */
+    void SecureDataStorage::setDurability(Durability level)
+    {
+        durability = level;
+    }
+
+    /**
+     * Configure grouping of syncs of concurrent writers, it matters only with durability other than None.
+     * Syncs are grouped across all instances using the same folders, the last setting applies to all of them.
+     * @param batchSize is number of writers whose syncs are issued together at most
+     * @param windowMicroseconds is how long the first writer of a group waits for others
+     */
+    void SecureDataStorage::setGroupCommit(size_t batchSize, uint32_t windowMicroseconds)
+    {
+        std::lock_guard<std::mutex> lock(openMutex);
+        groupCommitSet = true;
+        groupCommitBatch = batchSize;
+        groupCommitWindow = windowMicroseconds;
+        if (shared)
+        {
+            shared->syncGroup.configure(batchSize, std::chrono::microseconds(windowMicroseconds));
+        }
+    }
+
+    /**
+     * Number of sync groups issued and sync requests they served by all instances using the same folders,
+     * their ratio is average size of group
+     * @param groups is number of groups
+     * @param requests is number of requests
+     */
+    void SecureDataStorage::getGroupCommitStats(uint64_t &groups, uint64_t &requests) const
+    {
+        groups = opened ? shared->syncGroup.groups.load() : 0;
+        requests = opened ? shared->syncGroup.requests.load() : 0;
+    }
 
-        std::string saltString;
-        generateSalt(saltString);
+    /**
+     * Set how long retrieve waits for the two fastest replicas before it reads the third one too
+     * @param deadlineMicroseconds is the deadline, zero reads all replicas every time
+     */
+    void SecureDataStorage::setReadHedging(uint32_t deadlineMicroseconds)
+    {
+        hedgeDeadline = deadlineMicroseconds;
+    }
 
-        std::string plaintext = "int" + std::to_string(data);
-        std::string ciphertext;
+    /**
+     * Read latency of every PISSD folder, reads of all instances using the same folders count into it
+     * @param stats is array of three statistics, one for each folder in order of getRootPaths
+     */
+    void SecureDataStorage::getReplicaStats(ReplicaStats stats[])
+    {
+        for (int i = 0; i < 3; ++i)
+        {
+            stats[i] = opened ? shared->replicaStore->getReplicaStats(i) : ReplicaStats();
+        }
+    }
 
-        plaintext += SHA512HashString(plaintext) + saltString;
+    /**
+     * Set number of replicas that have to be written before store reports success, the others are written
+     * in background. Store that does not reach quorum fails. Retrieve trusts majority of replicas, so quorum
+     * cannot be lower than two, and overwrite that fails quorum of three with two replicas written is
+     * already what retrieve returns.
+     * @param replicas is 2 or 3, 2 by default
+     * @return non-zero value if quorum is not valid
+     */
+    int SecureDataStorage::setWriteQuorum(int replicas)
+    {
+        if (replicas < 2 || replicas > 3)
+        {
+            return -1;
+        }
+        writeQuorum = replicas;
 
-        initializeKeyAndIV(dataKey, key, iv);
+        return 0;
+    }
 
-        encryptData(plaintext, ciphertext, key, iv);
+    /**
+     * Number of replica writes that failed, including those finished in background, of all instances
+     * using the same folders
+     * @return count of failed writes
+     */
+    uint64_t SecureDataStorage::getFailedReplicaWrites() const
+    {
+        return opened ? shared->replicaStore->failedWrites.load() : 0;
+    }
 
-        std::lock_guard<std::mutex> lock(*lgMutex);
+    /**
+     * Number of replicas rewritten by retrieve because they differed from the majority, of all instances
+     * using the same folders
+     * @return count of repaired replicas
+     */
+    uint64_t SecureDataStorage::getReadRepairs() const
+    {
+        return opened ? shared->replicaStore->repairedReplicas.load() : 0;
+    }
 
-        createFile(dataKey.c_str(), ciphertext);
+    /**
+     * Start background scrubber or change policy of running one. Scrubber compares replicas of every key
+     * and repairs those that differ from the majority.
+     * @param policy is budget and interval of scrubbing
+     */
+    void SecureDataStorage::startScrubber(const ScrubPolicy &policy)
+    {
+        if (open() != 0)
+        {
+            return;
+        }
+        scrubber->start(policy, [this] { runScrubber(); });
+    }
 
-        return 0;
+    /**
+     * Pause scrubber after key it is checking
+     */
+    void SecureDataStorage::pauseScrubber()
+    {
+        scrubber->pause(true);
     }
 
     /**
-     * Store and cipher data
-     * @param dataKey is string containing key
-     * @param data is bool to be stored
-     * @return non-zero value if error occurs
+     * Resume paused scrubber
      */
-    int SecureDataStorage::storeData(const std::string &dataKey, bool &data)
+    void SecureDataStorage::resumeScrubber()
     {
-        CryptoPP::byte key[CryptoPP::AES::MAX_KEYLENGTH], iv[CryptoPP::AES::MAX_KEYLENGTH];
+        scrubber->pause(false);
+    }
 
-        CryptoPP::SecByteBlock derived(64);
+    /**
+     * Progress of scrubber
+     * @return progress of current pass and totals since scrubber started
+     */
+    ScrubProgress SecureDataStorage::getScrubProgress()
+    {
+        return scrubber->getProgress();
+    }
 
-        std::string saltString;
-        generateSalt(saltString);
+    /**
+     * Number of keys whose replica missed its latest write and waits for repair
+     * @return count of keys
+     */
+    size_t SecureDataStorage::getPendingRepairs() const
+    {
+        return opened ? shared->replicaStore->pendingRepairs.load() : 0;
+    }
 
-        std::string plaintext = "bol";
-        if (data)
+    /**
+     * Configure when and how fast segment engine reclaims space of overwritten and deleted records.
+     * Segments are compacted for all instances using the same folders, the last setting applies to all of them.
+     * @param policy is new policy
+     */
+    void SecureDataStorage::setCompactionPolicy(const CompactionPolicy &policy)
+    {
+        std::lock_guard<std::mutex> lock(openMutex);
+        compactionPolicySet = true;
+        compactionPolicy = policy;
+        if (shared)
         {
-            plaintext += "true";
-        } else
+            shared->replicaStore->setCompactionPolicy(policy);
+        }
+    }
+
+    /**
+     * Statistics of segment compaction, all zero for file engine
+     * @return statistics over all replicas
+     */
+    CompactionStats SecureDataStorage::getCompactionStats()
+    {
+        return opened ? shared->replicaStore->getCompactionStats() : CompactionStats();
+    }
+
+    /**
+     * Number of retrieve operations that did not find the key
+     * @return count of misses
+     */
+    uint64_t SecureDataStorage::getRetrieveMisses() const
+    {
+        return retrieveMisses;
+    }
+
+    /**
+     * Cipher plain text and save it to all replicas
+     * @param module is path to module as string, empty for root
+     * @param dataKey is string containing key
+     * @param plaintext is type tag followed by serialized value, see encodeValue
+     * @return non-zero value if error occurs
+     */
+    int SecureDataStorage::storeRecord(const std::string &module, const std::string &dataKey,
+                                       const std::string &plaintext)
+    {
+        std::string nonce;
+        std::string record;
+
+        if (open() != 0)
         {
-            plaintext += "false";
+            return -1;
         }
-        std::string ciphertext;
 
-        plaintext += SHA512HashString(plaintext) + saltString;
+        saltPool->generate(nonce, NONCESIZE);
+
+        std::shared_ptr<KeyMaterial> material = keyCache->get(masterKey, dataKey);
 
-        initializeKeyAndIV(dataKey, key, iv);
+        encryptRecord(plaintext, record, *material, nonce);
 
-        encryptData(plaintext, ciphertext, key, iv);
+        std::string normalized = normalizeModule(module);
+        bool compact = false;
+        {
+            ScopedLock lock(shared->lockManager, module, dataKey, true);
+            ensureRootDirs();
 
-        std::lock_guard<std::mutex> lock(*lgMutex);
+            // New key is journaled ahead of its files, so crash cannot hide stored data from the manifest.
+            // Overwrite does not change the catalog, so it leaves the journal alone.
+            bool existed = shared->keyIndex.containsKey(normalized, dataKey);
+            if (!existed)
+            {
+                compact = shared->manifest.log(MANIFEST_ADD_KEY, normalized, dataKey,
+                                               durability != Durability::None);
+            }
+            int quorum = writeQuorum;
+            if (shared->replicaStore->write(normalized, dataKey, record, durability, quorum) < quorum)
+            {
+                // Record below quorum is not stored, replicas that got a new key are withdrawn
+                if (!existed)
+                {
+                    shared->replicaStore->remove(normalized, dataKey, durability);
+                    shared->replicaStore->forgetRepairs(normalized, dataKey);
+                    shared->manifest.log(MANIFEST_REMOVE_KEY, normalized, dataKey, durability != Durability::None);
+                }
+                return -1;
+            }
+            shared->keyIndex.addKey(normalized, dataKey);
+        }
 
-        createFile(dataKey.c_str(), ciphertext);
+        if (compact)
+        {
+            compactManifest();
+        }
 
         return 0;
     }
 
-
     /**
-     * Get stored data back and decipher it
+     * Load all replicas, decipher them and vote on the result
+     * @param module is path to module as string, empty for root
      * @param dataKey is string containing key
-     * @param data is variable where new data will be stored
-     * @return non-zero value, if error occurs
+     * @param type is expected type tag of stored value
+     * @param data is serialized value without type tag
+     * @return 0 if all replicas read agree, 1 if they differ, -1 if key does not exist, -2 if no replica can be read
      */
-    int SecureDataStorage::retrieveData(const std::string &dataKey, std::string &data)
+    int SecureDataStorage::retrieveRecord(const std::string &module, const std::string &dataKey,
+                                          char type, std::string &data)
     {
         std::string dataToRead[3];
-        std::string temp[3];
+        bool loaded[3];
         std::vector<std::string> possibleData;
         bool carefulFlag = true;
 
-        std::lock_guard<std::mutex> lock(*lgMutex);
+        if (open() != 0)
+        {
+            return -1;
+        }
 
-        int loadedFileCheck = loadFile(dataToRead, dataKey);
-        if (loadedFileCheck == 0)
+        // Index is shared by every instance of this process using the same folders and other processes
+        // cannot open them, so it knows every stored key and misses are answered without touching the disk
+        if (!shared->keyIndex.containsKey(normalizeModule(module), dataKey))
         {
-            if (compareCiphertext(dataToRead) > 1)
-            {
-                carefulFlag = false;
-            }
-            for (int i = 0; i < 3; ++i)
+            retrieveMisses++;
+            return -1;
+        }
+
+        // Replica behind quorum may still be written when it is read, so it does not count as diverging
+        int loadedFileCheck;
+        bool writing;
+        {
+            ScopedLock lock(shared->lockManager, module, dataKey, false);
+            writing = shared->replicaStore->isWriting(normalizeModule(module), dataKey);
+            loadedFileCheck = shared->replicaStore->read(normalizeModule(module), dataKey, dataToRead, loaded,
+                                                          hedgeDeadline);
+        }
+
+        if (loadedFileCheck == 2)
+        {
+            retrieveMisses++;
+            return -1;
+        }
+
+        // Replicas skipped by hedged read are not known to differ
+        if (compareCiphertext(dataToRead, loaded))
+        {
+            carefulFlag = false;
+        }
+
+        std::shared_ptr<KeyMaterial> material = keyCache->get(masterKey, dataKey);
+
+        // Two byte-identical replicas decide the result, so only one of them is deciphered
+        int quorum = findQuorum(dataToRead);
+        if (quorum >= 0)
+        {
+            std::string temp;
+            if (openRecord(identity, dataKey, *material, dataToRead[quorum], temp)
+                && checkValue(temp, type))
             {
-                temp[i] = decrypthData(dataKey, dataToRead[i]);
-                if (checkHash(temp[i]) == 0)
+                data = temp.substr(1);
+                if (carefulFlag && !writing)
                 {
-                    temp[i].erase(temp[i].end() - 90, temp[i].end());
-                    if (temp[i].substr(0, 3) == "str")
-                    {
-                        temp[i].erase(0, 3);
-                        possibleData.push_back(temp[i]);
-                    }
+                    repairRecord(module, dataKey, dataToRead[quorum], dataToRead, loaded);
+                    return 1;
                 }
+
+                return 0;
             }
-        } else if (loadedFileCheck < 3)
+        }
+
+        // Replicas diverge, each one borrows its own cipher contexts so they are verified in parallel
+        std::string temp[3];
+        auto verifyReplica = [&](int i) -> bool
         {
-            std::string temp;
-            for (int i = 0; i < loadedFileCheck; ++i)
+            if (dataToRead[i].empty())
             {
-                temp = decrypthData(dataKey, dataToRead[i]);
-                if (checkHash(temp) == 0)
-                {
-                    temp.erase(temp.end() - 90, temp.end());
-                    if (temp.substr(0, 3) == "str")
-                    {
-                        temp.erase(0, 3);
-                        possibleData.push_back(temp);
-                    }
-                }
+                return false;
+            }
+
+            return openRecord(identity, dataKey, *material, dataToRead[i], temp[i])
+                   && checkValue(temp[i], type);
+        };
+
+        std::future<bool> verified[3];
+        bool valid[3];
+        for (int i = 1; i < 3; ++i)
+        {
+            verified[i] = shared->workerPool->submit(std::bind(verifyReplica, i));
+        }
+
+        valid[0] = verifyReplica(0);
+        for (int i = 1; i < 3; ++i)
+        {
+            valid[i] = verified[i].get();
+        }
+        for (int i = 0; i < 3; ++i)
+        {
+            if (valid[i])
+            {
+                possibleData.push_back(temp[i].substr(1));
             }
         }
 
-        if (loadedFileCheck == 3 || possibleData.empty())
+        if (possibleData.empty())
         {
-            std::cerr << "No file found\n";
-            data = "";
-            return -1;
+            return -2;
         }
 
         data = findSameStrings(possibleData);
 
+        // Value is repaired only when majority of replicas holds it, lone replica may be the stale one
+        int source = -1;
+        int votes = 0;
+        for (int i = 0; i < 3; ++i)
+        {
+            if (valid[i] && temp[i].substr(1) == data)
+            {
+                source = source < 0 ? i : source;
+                votes++;
+            }
+        }
+        if (carefulFlag && votes >= 2)
+        {
+            repairRecord(module, dataKey, dataToRead[source], dataToRead, loaded);
+        }
+
         if (carefulFlag)
         {
             return 1;
@@ -849,72 +5160,191 @@ namespace PISSD
     }
 
     /**
-     * Get stored data back and decipher it
+     * Let lanes of replicas rewrite those that differ from majority record, retrieve does not wait for it
+     * @param module is path to module as string, empty for root
      * @param dataKey is string containing key
-     * @param data is variable where new data will be stored
-     * @return non-zero value, if error occurs
+     * @param record is record agreed by majority of replicas
+     * @param data is array of records retrieve found
+     * @param loaded is array of flags of replicas retrieve read
      */
-    int SecureDataStorage::retrieveData(const std::string &dataKey, double &data)
+    void SecureDataStorage::repairRecord(const std::string &module, const std::string &dataKey,
+                                         const std::string &record, const std::string data[], const bool loaded[])
+    {
+        // Repair is queued under key lock, so key removed meanwhile does not get its replicas back
+        ScopedLock lock(shared->lockManager, module, dataKey, false);
+        if (shared->keyIndex.containsKey(normalizeModule(module), dataKey))
+        {
+            shared->replicaStore->repair(normalizeModule(module), dataKey, record, data, loaded, durability);
+        }
+    }
+
+    /**
+     * Check replicas of one key and repair them if they differ, records are deciphered only when sizes
+     * or checksums of replicas do not match
+     * @param module is normalized path to module
+     * @param dataKey is string containing key
+     * @param bytes is number of bytes read
+     * @return 0 if replicas agree, 1 if their repair was scheduled, 2 if they have no majority
+     */
+    int SecureDataStorage::scrubRecord(const std::string &module, const std::string &dataKey, uint64_t &bytes)
     {
         std::string dataToRead[3];
+        bool loaded[3] = {true, true, true};
+        {
+            // Key whose write still finishes in background is checked by the next pass
+            ScopedLock lock(shared->lockManager, module, dataKey, false);
+            if (!shared->keyIndex.containsKey(module, dataKey) || shared->replicaStore->isWriting(module, dataKey))
+            {
+                return 0;
+            }
+            shared->replicaStore->readAll(module, dataKey, dataToRead);
+        }
+
+        // Replicas are already in memory, so they are compared byte by byte instead of by checksum
+        bytes = dataToRead[0].size() + dataToRead[1].size() + dataToRead[2].size();
+        if (compareCiphertext(dataToRead, loaded))
+        {
+            return 0;
+        }
+
+        // Two byte-identical replicas decide, so only one of them is deciphered
+        std::shared_ptr<KeyMaterial> material = keyCache->get(masterKey, dataKey);
         std::string temp[3];
-        std::vector<std::string> possibleData;
-        bool carefulFlag = true;
+        int quorum = findQuorum(dataToRead);
+        if (quorum >= 0 && openRecord(identity, dataKey, *material, dataToRead[quorum], temp[0])
+            && checkValue(temp[0], temp[0][0]))
+        {
+            repairRecord(module, dataKey, dataToRead[quorum], dataToRead, loaded);
+            return 1;
+        }
 
-        std::lock_guard<std::mutex> lock(*lgMutex);
+        bool valid[3];
+        for (int i = 0; i < 3; ++i)
+        {
+            valid[i] = !dataToRead[i].empty()
+                       && openRecord(identity, dataKey, *material, dataToRead[i], temp[i])
+                       && checkValue(temp[i], temp[i][0]);
+        }
 
-        int loadedFileCheck = loadFile(dataToRead, dataKey);
-        if (loadedFileCheck == 0)
+        for (int i = 0; i < 3; ++i)
         {
-            if (compareCiphertext(dataToRead) > 1)
-            {
-                carefulFlag = false;
-            }
-            for (int i = 0; i < 3; ++i)
+            for (int j = i + 1; j < 3; ++j)
             {
-                temp[i] = decrypthData(dataKey, dataToRead[i]);
-                if (checkHash(temp[i]) == 0)
+                if (valid[i] && valid[j] && temp[i] == temp[j])
                 {
-                    temp[i].erase(temp[i].end() - 90, temp[i].end());
-                    if (temp[i].substr(0, 3) == "dbl")
-                    {
-                        temp[i].erase(0, 3);
-                        possibleData.push_back(temp[i]);
-                    }
+                    repairRecord(module, dataKey, dataToRead[i], dataToRead, loaded);
+                    return 1;
                 }
             }
-        } else if (loadedFileCheck < 3)
+        }
+
+        return 2;
+    }
+
+    /**
+     * Body of scrubber thread, it walks keys known at start of each pass
+     */
+    void SecureDataStorage::runScrubber()
+    {
+        do
         {
-            std::string temp;
-            for (int i = 0; i < loadedFileCheck; ++i)
+            std::vector<std::pair<std::string, std::string>> keys;
+            shared->keyIndex.forEachKey("", true, [&](const std::string &module, const std::string &key)
+            {
+                keys.emplace_back(module, key);
+            });
+
+            scrubber->beginPass(keys.size());
+            for (auto &key : keys)
             {
-                temp = decrypthData(dataKey, dataToRead[i]);
-                if (checkHash(temp) == 0)
+                if (!scrubber->proceed())
                 {
-                    temp.erase(temp.end() - 90, temp.end());
-                    if (temp.substr(0, 3) == "dbl")
-                    {
-                        temp.erase(0, 3);
-                        possibleData.push_back(temp);
-                    }
+                    return;
                 }
+
+                uint64_t bytes = 0;
+                int result = scrubRecord(key.first, key.second, bytes);
+                scrubber->account(result, bytes);
             }
-        }
+        } while (scrubber->rest());
+    }
 
-        if (loadedFileCheck == 3 || possibleData.empty())
-        {
-            std::cerr << "No file found\n";
-            return -1;
-        }
+    /**
+     * Store and cipher data
+     * @param dataKey is string containing key
+     * @param data is string to be stored
+     * @return non-zero value if error occurs
+     */
+    int SecureDataStorage::storeData(const std::string &dataKey, std::string &data)
+    {
+        return storeDataToModule("", dataKey, data);
+    }
 
-        data = std::stod(findSameStrings(possibleData));
+    /**
+     * Store and cipher data
+     * @param dataKey is string containing key
+     * @param data is double to be stored
+     * @return non-zero value if error occurs
+     */
+    int SecureDataStorage::storeData(const std::string &dataKey, double &data)
+    {
+        return storeDataToModule("", dataKey, data);
+    }
 
-        if (carefulFlag)
-        {
-            return 1;
-        }
+    /**
+     * Store and cipher data
+     * @param dataKey is string containing key
+     * @param data is float to be stored
+     * @return non-zero value if error occurs
+     */
+    int SecureDataStorage::storeData(const std::string &dataKey, float &data)
+    {
+        return storeDataToModule("", dataKey, data);
+    }
+
+    /**
+     * Store and cipher data
+     * @param dataKey is string containing key
+     * @param data is int64 to be stored
+     * @return non-zero value if error occurs
+     */
+    int SecureDataStorage::storeData(const std::string &dataKey, int64_t &data)
+    {
+        return storeDataToModule("", dataKey, data);
+    }
+
+    /**
+     * Store and cipher data
+     * @param dataKey is string containing key
+     * @param data is bool to be stored
+     * @return non-zero value if error occurs
+     */
+    int SecureDataStorage::storeData(const std::string &dataKey, bool &data)
+    {
+        return storeDataToModule("", dataKey, data);
+    }
+
+
+    /**
+     * Get stored data back and decipher it
+     * @param dataKey is string containing key
+     * @param data is variable where new data will be stored
+     * @return non-zero value, if error occurs
+     */
+    int SecureDataStorage::retrieveData(const std::string &dataKey, std::string &data)
+    {
+        return retrieveDataFromModule("", dataKey, data);
+    }
 
-        return 0;
+    /**
+     * Get stored data back and decipher it
+     * @param dataKey is string containing key
+     * @param data is variable where new data will be stored
+     * @return non-zero value, if error occurs
+     */
+    int SecureDataStorage::retrieveData(const std::string &dataKey, double &data)
+    {
+        return retrieveDataFromModule("", dataKey, data);
     }
 
     /**
@@ -925,65 +5355,7 @@ namespace PISSD
      */
     int SecureDataStorage::retrieveData(const std::string &dataKey, float &data)
     {
-        std::string dataToRead[3];
-        std::string temp[3];
-        std::vector<std::string> possibleData;
-        bool carefulFlag = true;
-
-        std::lock_guard<std::mutex> lock(*lgMutex);
-
-        int loadedFileCheck = loadFile(dataToRead, dataKey);
-        if (loadedFileCheck == 0)
-        {
-            if (compareCiphertext(dataToRead) > 1)
-            {
-                carefulFlag = false;
-            }
-            for (int i = 0; i < 3; ++i)
-            {
-                temp[i] = decrypthData(dataKey, dataToRead[i]);
-                if (checkHash(temp[i]) == 0)
-                {
-                    temp[i].erase(temp[i].end() - 90, temp[i].end());
-                    if (temp[i].substr(0, 3) == "flt")
-                    {
-                        temp[i].erase(0, 3);
-                        possibleData.push_back(temp[i]);
-                    }
-                }
-            }
-        } else if (loadedFileCheck < 3)
-        {
-            std::string temp;
-            for (int i = 0; i < loadedFileCheck; ++i)
-            {
-                temp = decrypthData(dataKey, dataToRead[i]);
-                if (checkHash(temp) == 0)
-                {
-                    temp.erase(temp.end() - 90, temp.end());
-                    if (temp.substr(0, 3) == "flt")
-                    {
-                        temp.erase(0, 3);
-                        possibleData.push_back(temp);
-                    }
-                }
-            }
-        }
-
-        if (loadedFileCheck == 3 || possibleData.empty())
-        {
-            std::cerr << "No file found\n";
-            return -1;
-        }
-
-        data = std::stof(findSameStrings(possibleData));
-
-        if (carefulFlag)
-        {
-            return 1;
-        }
-
-        return 0;
+        return retrieveDataFromModule("", dataKey, data);
     }
 
     /**
@@ -994,65 +5366,7 @@ namespace PISSD
      */
     int SecureDataStorage::retrieveData(const std::string &dataKey, int64_t &data)
     {
-        std::string dataToRead[3];
-        std::string temp[3];
-        std::vector<std::string> possibleData;
-        bool carefulFlag = true;
-
-        std::lock_guard<std::mutex> lock(*lgMutex);
-
-        int loadedFileCheck = loadFile(dataToRead, dataKey);
-        if (loadedFileCheck == 0)
-        {
-            if (compareCiphertext(dataToRead) > 1)
-            {
-                carefulFlag = false;
-            }
-            for (int i = 0; i < 3; ++i)
-            {
-                temp[i] = decrypthData(dataKey, dataToRead[i]);
-                if (checkHash(temp[i]) == 0)
-                {
-                    temp[i].erase(temp[i].end() - 90, temp[i].end());
-                    if (temp[i].substr(0, 3) == "int")
-                    {
-                        temp[i].erase(0, 3);
-                        possibleData.push_back(temp[i]);
-                    }
-                }
-            }
-        } else if (loadedFileCheck < 3)
-        {
-            std::string temp;
-            for (int i = 0; i < loadedFileCheck; ++i)
-            {
-                temp = decrypthData(dataKey, dataToRead[i]);
-                if (checkHash(temp) == 0)
-                {
-                    temp.erase(temp.end() - 90, temp.end());
-                    if (temp.substr(0, 3) == "int")
-                    {
-                        temp.erase(0, 3);
-                        possibleData.push_back(temp);
-                    }
-                }
-            }
-        }
-
-        if (loadedFileCheck == 3 || possibleData.empty())
-        {
-            std::cerr << "No file found\n";
-            return -1;
-        }
-
-        data = std::stoll(findSameStrings(possibleData));
-
-        if (carefulFlag)
-        {
-            return 1;
-        }
-
-        return 0;
+        return retrieveDataFromModule("", dataKey, data);
     }
 
     /**
@@ -1063,75 +5377,7 @@ namespace PISSD
      */
     int SecureDataStorage::retrieveData(const std::string &dataKey, bool &data)
     {
-        std::string dataToRead[3];
-        std::string temp[3];
-        std::vector<std::string> possibleData;
-        bool carefulFlag = true;
-
-        std::lock_guard<std::mutex> lock(*lgMutex);
-
-        int loadedFileCheck = loadFile(dataToRead, dataKey);
-        if (loadedFileCheck == 0)
-        {
-            if (compareCiphertext(dataToRead) > 1)
-            {
-                carefulFlag = false;
-            }
-            for (int i = 0; i < 3; ++i)
-            {
-                temp[i] = decrypthData(dataKey, dataToRead[i]);
-                if (checkHash(temp[i]) == 0)
-                {
-                    temp[i].erase(temp[i].end() - 90, temp[i].end());
-                    if (temp[i].substr(0, 3) == "bol")
-                    {
-                        temp[i].erase(0, 3);
-                        possibleData.push_back(temp[i]);
-                    }
-                }
-            }
-        } else if (loadedFileCheck < 3)
-        {
-            std::string temp;
-            for (int i = 0; i < loadedFileCheck; ++i)
-            {
-                temp = decrypthData(dataKey, dataToRead[i]);
-                if (checkHash(temp) == 0)
-                {
-                    temp.erase(temp.end() - 90, temp.end());
-                    if (temp.substr(0, 3) == "bol")
-                    {
-                        temp.erase(0, 3);
-                        possibleData.push_back(temp);
-                    }
-                }
-            }
-        }
-
-        if (loadedFileCheck == 3 || possibleData.empty())
-        {
-            std::cerr << "No file found\n";
-            return -1;
-        }
-
-        if (findSameStrings(possibleData) == "true")
-        {
-            data = true;
-        } else if (findSameStrings(possibleData) == "false")
-        {
-            data = false;
-        } else
-        {
-            return 2;
-        }
-
-        if (carefulFlag)
-        {
-            return 1;
-        }
-
-
-        return 0;
+        return retrieveDataFromModule("", dataKey, data);
     }
 
     /**
@@ -1140,20 +5386,16 @@ namespace PISSD
      */
     void SecureDataStorage::deleteStoredData(std::string &dataKey)
     {
-        std::string pathsToFile[3];
-
-        std::lock_guard<std::mutex> lock(*lgMutex);
-        getDirPath(pathsToFile);
-        for (auto &path : pathsToFile)
+        if (open() != 0)
         {
-            path += "/." + dataKey + ".jkl";
-#ifdef WIN32
-            DeleteFile(path.c_str());
-#endif
-#ifdef __APPLE__
-            std::remove(path.c_str());
-#endif
+            return;
         }
+        ScopedLock lock(shared->lockManager, "", dataKey, true);
+        shared->replicaStore->drain();
+        shared->replicaStore->remove("", dataKey, durability);
+        shared->replicaStore->forgetRepairs("", dataKey);
+        shared->manifest.log(MANIFEST_REMOVE_KEY, "", dataKey, durability != Durability::None);
+        shared->keyIndex.removeKey("", dataKey);
     }
 
     /**
@@ -1164,13 +5406,32 @@ namespace PISSD
         boost::filesystem::path boostPath;
         std::string dirPath[3];
 
-        std::lock_guard<std::mutex> lock(*lgMutex);
-        getDirPath(dirPath);
+        if (getRootPaths(dirPath) != 0)
+        {
+            return;
+        }
+        ScopedLock lock(shared->lockManager, true);
+        shared->replicaStore->drain();
+        std::vector<SyncTarget> targets;
         for (int i = 0; i < 3; ++i)
         {
             boostPath = dirPath[i] + "/";
             boost::filesystem::remove_all(boostPath);
+            if (durability == Durability::DirectorySync)
+            {
+                std::string parent = boost::filesystem::path(dirPath[i]).parent_path().string();
+                targets.push_back({parent, parent, false});
+            }
+        }
+        if (!targets.empty())
+        {
+            shared->syncGroup.sync(targets);
         }
+        shared->rootsCreated = false;
+        shared->manifest.reset();
+        shared->replicaStore->reset();
+        shared->replicaStore->forgetRepairs("", "");
+        shared->keyIndex.clear();
     }
 
     /**
@@ -1184,8 +5445,12 @@ namespace PISSD
         std::string dirPath[3];
         struct stat st = {0};
 
-        std::lock_guard<std::mutex> lock(*lgMutex);
-        getDirPath(dirPath);
+        if (getRootPaths(dirPath) != 0)
+        {
+            return -1;
+        }
+        ScopedLock lock(shared->lockManager, (path == "*" || path.empty()) ? name : path + "/" + name, true);
+        ensureRootDirs();
         if (path == "*" || path.empty())
         {
             for (int i = 0; i < 3; ++i)
@@ -1197,6 +5462,9 @@ namespace PISSD
                     mkpath_np(dirPath[i].c_str() ,0700);
                 }
 #endif
+#ifdef __linux__
+                createLinuxDir(dirPath[i]);
+#endif
 
 #ifdef WIN32
                 CreateDirectory(dirPath[i].c_str(), NULL);
@@ -1215,6 +5483,9 @@ namespace PISSD
                     mkpath_np(dirPath[i].c_str() ,0700);
                 }
 #endif
+#ifdef __linux__
+                createLinuxDir(dirPath[i]);
+#endif
 
 #ifdef WIN32
                 CreateDirectory(dirPath[i].c_str(), NULL);
@@ -1222,6 +5493,9 @@ namespace PISSD
 #endif
             }
         }
+        std::string module = normalizeModule((path == "*" || path.empty()) ? name : path + "/" + name);
+        shared->manifest.log(MANIFEST_ADD_MODULE, module, "", durability != Durability::None);
+        shared->keyIndex.addModule(module);
 
         return 0;
     }
@@ -1236,13 +5510,22 @@ namespace PISSD
         boost::filesystem::path boostPath;
         std::string dirPath[3];
 
-        std::lock_guard<std::mutex> lock(*lgMutex);
-        getDirPath(dirPath);
+        if (getRootPaths(dirPath) != 0)
+        {
+            return -1;
+        }
+        ScopedLock lock(shared->lockManager, path, true);
+        shared->replicaStore->drain();
         for (int i = 0; i < 3; ++i)
         {
             boostPath = dirPath[i] + "/" + path;
             boost::filesystem::remove_all(boostPath);
         }
+        shared->replicaStore->removeModule(normalizeModule(path), durability);
+        shared->replicaStore->forgetRepairs(normalizeModule(path), "");
+        shared->manifest.log(MANIFEST_REMOVE_MODULE, normalizeModule(path), "", durability != Durability::None);
+        shared->keyIndex.removeModule(normalizeModule(path));
+
         return 0;
     }
 
@@ -1255,12 +5538,45 @@ namespace PISSD
         boost::filesystem::path boostPath;
         std::string dirPath[3];
 
-        std::lock_guard<std::mutex> lock(*lgMutex);
-        getDirPath(dirPath);
+        if (getRootPaths(dirPath) != 0)
+        {
+            return;
+        }
+        ScopedLock lock(shared->lockManager, path, true);
+
+        // Segment engine keeps keys outside module folders, so only index tells if module is empty
+        bool empty = true;
+        shared->keyIndex.forEachKey(normalizeModule(path), true, [&](const std::string &, const std::string &)
+        {
+            empty = false;
+        });
+        if (!empty)
+        {
+            return;
+        }
+
+        std::vector<SyncTarget> targets;
         for (int i = 0; i < 3; ++i)
         {
             boostPath = dirPath[i] + "/" + path;
             boost::filesystem::remove(boostPath);
+            if (durability == Durability::DirectorySync)
+            {
+                std::string parent = boost::filesystem::path(dirPath[i] + "/" + normalizeModule(path)).parent_path()
+                        .string();
+                targets.push_back({dirPath[i], parent, false});
+            }
+        }
+
+        // Only empty module can be removed, so index changes only if the folder is gone
+        if (!boost::filesystem::exists(dirPath[0] + "/" + path))
+        {
+            if (!targets.empty())
+            {
+                shared->syncGroup.sync(targets);
+            }
+            shared->manifest.log(MANIFEST_REMOVE_MODULE, normalizeModule(path), "", durability != Durability::None);
+            shared->keyIndex.removeModule(normalizeModule(path));
         }
     }
 
@@ -1271,53 +5587,18 @@ namespace PISSD
      */
     void SecureDataStorage::getAllKeys(std::vector<std::string> &paths, std::vector<std::string> &keys)
     {
-        std::string dirPath[3];
-        getDirPath(dirPath);
-
-        std::lock_guard<std::mutex> lock(*lgMutex);
-        std::vector<std::string> lPaths[3], lKeys[3];
-        for (int i = 0; i < 3; ++i)
+        paths.clear();
+        keys.clear();
+        if (open() != 0)
         {
-            boost::filesystem::path targetDir = dirPath[i];
-            boost::filesystem::recursive_directory_iterator it( targetDir ), eod;
-
-
-            BOOST_FOREACH(boost::filesystem::path const &p, std::make_pair(it, eod))
-            {
-                if(is_regular_file(p))
-                {
-                    if (p.filename().string() != ".DS_Store")
-                    {
-                        std::string filepath = p.branch_path().string();
-                        filepath.erase(0, dirPath[i].size());
-                        lPaths[i].push_back(filepath);
-                        lKeys[i].push_back(stripExtension(p.filename().string()));
-                    }
-                }
-            }
+            return;
         }
 
-        int max = 0;
-        for (int i = 0; i < 3; ++i)
+        shared->keyIndex.forEachKey("", true, [&](const std::string &module, const std::string &key)
         {
-            for (int j = i; j < 3; ++j)
-            {
-                if (lPaths[i].size() == lPaths[j].size())
-                {
-                    paths = lPaths[i];
-                    keys = lKeys[i];
-                    return;
-                } else if (lPaths[i].size() > lPaths[j].size())
-                {
-                    max = i;
-                } else
-                {
-                    max = j;
-                }
-            }
-        }
-        paths = lPaths[max];
-        keys = lKeys[max];
+            paths.push_back(module.empty() ? "" : "/" + module);
+            keys.push_back(key);
+        });
     }
 
     /**
@@ -1326,79 +5607,167 @@ namespace PISSD
      */
     void SecureDataStorage::getAllModules(std::vector<std::string> &modules)
     {
-        std::string dirPath[3];
-        getDirPath(dirPath);
-
-        std::lock_guard<std::mutex> lock(*lgMutex);
-        for (int i = 0; i < 3; ++i)
+        if (open() != 0)
         {
-            boost::filesystem::path targetDir = dirPath[i];
-            boost::filesystem::recursive_directory_iterator it( targetDir ), eod;
-
-            BOOST_FOREACH(boost::filesystem::path const &p, std::make_pair(it, eod))
-            {
-                if(is_directory(p))
-                {
-                    std::string modulePath = p.generic_path().string();
-                    modulePath.erase(0, dirPath[i].size() + 1);
-                    modules.push_back(modulePath);
-                }
-            }
+            return;
         }
+
+        shared->keyIndex.forEachModule("", [&](const std::string &module)
+        {
+            modules.push_back(module);
+        });
         std::sort(modules.begin(), modules.end());
         modules.erase(std::unique(modules.begin(), modules.end()), modules.end());
     }
 
     /**
-     * Find all submodules in module
-     * @param path is where should be sought
+     * Find module and all its submodules
+     * @param path is path to module where should be sought
      * @param modules is path to sub-modules as vector of strings
      */
     void SecureDataStorage::getAllSubmodules(std::string path, std::vector<std::string> &modules)
     {
-        std::string dirPath[3];
-        getDirPath(dirPath);
-
-        std::lock_guard<std::mutex> lock(*lgMutex);
-        for (int i = 0; i < 3; ++i)
+        if (open() != 0)
         {
-            boost::filesystem::path targetDir = dirPath[i];
-            boost::filesystem::recursive_directory_iterator it( targetDir ), eod;
+            return;
+        }
 
-            BOOST_FOREACH(boost::filesystem::path const &p, std::make_pair(it, eod))
-            {
-                if(is_directory(p))
-                {
-                    std::string modulePath = p.generic_path().string();
-                    modulePath.erase(0, dirPath[i].size() + 1);
-                    if (modulePath.find(path) != std::string::npos)
-                    {
-                        modules.push_back(modulePath);
-                    }
-                }
-            }
+        path = normalizeModule(path);
+        if (!path.empty())
+        {
+            modules.push_back(path);
         }
+        shared->keyIndex.forEachModule(path, [&](const std::string &module)
+        {
+            modules.push_back(module);
+        });
     }
 
     /**
-     * Check if key exists
+     * Check if key exists, it is answered by catalog of this process that alone holds the folders
      * @param dataKey to be checked as string
      * @return true, if key exists
      */
     bool SecureDataStorage::contains(const std::string &dataKey)
     {
-        std::vector<std::string> paths, keys;
+        if (open() != 0)
+        {
+            return false;
+        }
+
+        return shared->keyIndex.containsKey(dataKey);
+    }
+
+    /**
+     * List keys of module and its sub-modules page by page
+     * @param module is path to module as string, empty for all keys
+     * @param pageSize is maximal number of entries returned
+     * @param resumeToken is empty for first page, it is replaced by token of next page or by empty string
+     *                    after the last one
+     * @param entries is vector of module and key pairs
+     * @return non-zero value if resume token is invalid
+     */
+    int SecureDataStorage::listKeys(const std::string &module, size_t pageSize, std::string &resumeToken,
+                                    std::vector<std::pair<std::string, std::string>> &entries)
+    {
+        std::string normalized = normalizeModule(module);
+        std::vector<std::string> after;
+        std::string afterModule, afterKey;
+
+        if (open() != 0)
+        {
+            return -1;
+        }
+        entries.clear();
+
+        if (!resumeToken.empty())
+        {
+            if (!decodeResumeToken(resumeToken, afterModule, afterKey)
+                || (!normalized.empty() && afterModule != normalized
+                    && afterModule.compare(0, normalized.size() + 1, normalized + "/") != 0))
+            {
+                return -1;
+            }
+
+            std::string relative = normalized.empty() ? afterModule : afterModule.substr(normalized.size());
+            relative = normalizeModule(relative);
+            for (size_t begin = 0; begin < relative.size();)
+            {
+                size_t end = relative.find('/', begin);
+                end = end == std::string::npos ? relative.size() : end;
+                after.push_back(relative.substr(begin, end - begin));
+                begin = end + 1;
+            }
+        }
+
+        // One extra entry tells whether another page exists
+        shared->keyIndex.page(normalized, resumeToken.empty() ? nullptr : &after, afterKey, pageSize + 1, entries);
+
+        resumeToken.clear();
+        if (entries.size() > pageSize)
+        {
+            entries.pop_back();
+            if (!entries.empty())
+            {
+                resumeToken = encodeResumeToken(entries.back().first, entries.back().second);
+            }
+        }
+
+        return 0;
+    }
+
+    /**
+     * Create cursor over keys of module and its sub-modules
+     * @param storage is instance of storage
+     * @param module is path to module as string, empty for all keys
+     * @param pageSize is number of entries fetched at once
+     * @param resumeToken is token returned by getResumeToken, empty to start from the beginning
+     */
+    KeyCursor::KeyCursor(SecureDataStorage &storage, const std::string &module, size_t pageSize,
+                         const std::string &resumeToken)
+            : storage(storage), module(module), pageSize(pageSize == 0 ? 1 : pageSize), nextToken(resumeToken),
+              position(0), finished(false)
+    {
+    }
 
-        std::lock_guard<std::mutex> lock(*lgMutex);
-        getAllKeys(paths, keys);
-        for (auto key : keys)
+    /**
+     * Return next key, next page is fetched when the current one is exhausted
+     * @param module is path to module of key
+     * @param key is name of key
+     * @return false if there are no more keys or resume token is invalid
+     */
+    bool KeyCursor::next(std::string &module, std::string &key)
+    {
+        if (position == page.size())
         {
-            if (key == dataKey)
+            if (finished || storage.listKeys(this->module, pageSize, nextToken, page) != 0 || page.empty())
             {
-                return true;
+                finished = true;
+                return false;
             }
+            finished = nextToken.empty();
+            position = 0;
+        }
+
+        module = page[position].first;
+        key = page[position].second;
+        position++;
+
+        return true;
+    }
+
+    /**
+     * Token that resumes listing after the last key returned by next
+     * @return token as string
+     */
+    std::string KeyCursor::getResumeToken() const
+    {
+        if (position == 0)
+        {
+            return "";
         }
-        return false;
+
+        return encodeResumeToken(page[position - 1].first, page[position - 1].second);
     }
 
     /**
@@ -1411,56 +5780,18 @@ namespace PISSD
                                                  std::vector<std::string> &paths,
                                                  std::vector<std::string> &keys)
     {
-        std::string dirPath[3];
-        getDirPath(dirPath);
-
-        std::lock_guard<std::mutex> lock(*lgMutex);
-        std::vector<std::string> lPaths[3], lKeys[3];
-        for (int i = 0; i < 3; ++i)
+        paths.clear();
+        keys.clear();
+        if (open() != 0)
         {
-            boost::filesystem::path targetDir = dirPath[i];
-            boost::filesystem::recursive_directory_iterator it( targetDir ), eod;
-
-
-            BOOST_FOREACH(boost::filesystem::path const &p, std::make_pair(it, eod))
-            {
-                if(is_regular_file(p))
-                {
-                    if (p.filename().string() != ".DS_Store")
-                    {
-                        std::string filepath = p.branch_path().string();
-                        filepath.erase(0, dirPath[i].size() + 1);
-                        if (checkPath(filepath, module))
-                        {
-                            lPaths[i].push_back(filepath);
-                            lKeys[i].push_back(stripExtension(p.filename().string()));
-                        }
-                    }
-                }
-            }
+            return;
         }
 
-        int max = 0;
-        for (int i = 0; i < 3; ++i)
+        shared->keyIndex.forEachKey(normalizeModule(module), true, [&](const std::string &keyModule, const std::string &key)
         {
-            for (int j = i; j < 3; ++j)
-            {
-                if (lPaths[i].size() == lPaths[j].size())
-                {
-                    paths = lPaths[i];
-                    keys = lKeys[i];
-                    return;
-                } else if (lPaths[i].size() > lPaths[j].size())
-                {
-                    max = i;
-                } else
-                {
-                    max = j;
-                }
-            }
-        }
-        paths = lPaths[max];
-        keys = lKeys[max];
+            paths.push_back(keyModule);
+            keys.push_back(key);
+        });
     }
 
     /**
@@ -1473,57 +5804,18 @@ namespace PISSD
                                                     std::vector<std::string> &paths,
                                                     std::vector<std::string> &keys)
     {
-        std::string dirPath[3];
-        getDirPath(dirPath);
-        std::vector<std::string> lPaths[3], lKeys[3];
-
-        std::lock_guard<std::mutex> lock(*lgMutex);
-
-        for (int i = 0; i < 3; ++i)
+        paths.clear();
+        keys.clear();
+        if (open() != 0)
         {
-            boost::filesystem::path targetDir = dirPath[i];
-            boost::filesystem::recursive_directory_iterator it( targetDir ), eod;
-
-
-            BOOST_FOREACH(boost::filesystem::path const &p, std::make_pair(it, eod))
-            {
-                if(is_regular_file(p))
-                {
-                    if (p.filename().string() != ".DS_Store")
-                    {
-                        std::string filepath = p.branch_path().string();
-                        filepath.erase(0, dirPath[i].size());
-                        if (std::equal(module.rbegin(), module.rend(), filepath.rbegin()))
-                        {
-                            lPaths[i].push_back(filepath);
-                            lKeys[i].push_back(stripExtension(p.filename().string()));
-                        }
-                    }
-                }
-            }
+            return;
         }
 
-        int max = 0;
-        for (int i = 0; i < 3; ++i)
+        shared->keyIndex.forEachKey(normalizeModule(module), false, [&](const std::string &keyModule, const std::string &key)
         {
-            for (int j = i; j < 3; ++j)
-            {
-                if (lPaths[i].size() == lPaths[j].size())
-                {
-                    paths = lPaths[i];
-                    keys = lKeys[i];
-                    return;
-                } else if (lPaths[i].size() > lPaths[j].size())
-                {
-                    max = i;
-                } else
-                {
-                    max = j;
-                }
-            }
-        }
-        paths = lPaths[max];
-        keys = lKeys[max];
+            paths.push_back(keyModule.empty() ? "" : "/" + keyModule);
+            keys.push_back(key);
+        });
     }
 
     /**
@@ -1535,25 +5827,7 @@ namespace PISSD
      */
     int SecureDataStorage::storeDataToModule(std::string module, const std::string &dataKey, std::string &data)
     {
-        CryptoPP::byte key[CryptoPP::AES::MAX_KEYLENGTH], iv[CryptoPP::AES::MAX_KEYLENGTH];
-        CryptoPP::SecByteBlock derived(64);
-        std::string saltString;
-        std::string ciphertext;
-
-        std::lock_guard<std::mutex> lock(*lgMutex);
-        generateSalt(saltString);
-
-        std::string plaintext = "str" + data;
-
-        plaintext += SHA512HashString(plaintext) + saltString;
-
-        initializeKeyAndIV(dataKey, key, iv);
-
-        encryptData(plaintext, ciphertext, key, iv);
-
-        createFile(module, dataKey.c_str(), ciphertext);
-
-        return 0;
+        return storeRecord(module, dataKey, (char) VALUE_STRING + data);
     }
 
     /**
@@ -1565,26 +5839,10 @@ namespace PISSD
      */
     int SecureDataStorage::storeDataToModule(std::string module, const std::string &dataKey, double &data)
     {
-        CryptoPP::byte key[CryptoPP::AES::MAX_KEYLENGTH], iv[CryptoPP::AES::MAX_KEYLENGTH];
-        CryptoPP::SecByteBlock derived(64);
-        std::string saltString;
-        std::string ciphertext;
-
-        std::lock_guard<std::mutex> lock(*lgMutex);
-
-        generateSalt(saltString);
-
-        std::string plaintext = "dbl" + std::to_string(data);
-
-        plaintext += SHA512HashString(plaintext) + saltString;
-
-        initializeKeyAndIV(dataKey, key, iv);
-
-        encryptData(plaintext, ciphertext, key, iv);
+        uint64_t bits;
+        memcpy(&bits, &data, sizeof(bits));
 
-        createFile(module, dataKey.c_str(), ciphertext);
-
-        return 0;
+        return storeRecord(module, dataKey, encodeValue(VALUE_DOUBLE, bits, sizeof(bits)));
     }
 
     /**
@@ -1596,25 +5854,10 @@ namespace PISSD
      */
     int SecureDataStorage::storeDataToModule(std::string module, const std::string &dataKey, float &data)
     {
-        CryptoPP::byte key[CryptoPP::AES::MAX_KEYLENGTH], iv[CryptoPP::AES::MAX_KEYLENGTH];
-        CryptoPP::SecByteBlock derived(64);
-        std::string saltString;
-        std::string ciphertext;
-
-        std::lock_guard<std::mutex> lock(*lgMutex);
-        generateSalt(saltString);
-
-        std::string plaintext = "flt" + std::to_string(data);
-
-        plaintext += SHA512HashString(plaintext) + saltString;
-
-        initializeKeyAndIV(dataKey, key, iv);
-
-        encryptData(plaintext, ciphertext, key, iv);
-
-        createFile(module, dataKey.c_str(), ciphertext);
+        uint32_t bits;
+        memcpy(&bits, &data, sizeof(bits));
 
-        return 0;
+        return storeRecord(module, dataKey, encodeValue(VALUE_FLOAT, bits, sizeof(bits)));
     }
 
     /**
@@ -1626,25 +5869,7 @@ namespace PISSD
      */
     int SecureDataStorage::storeDataToModule(std::string module, const std::string &dataKey, int64_t &data)
     {
-        CryptoPP::byte key[CryptoPP::AES::MAX_KEYLENGTH], iv[CryptoPP::AES::MAX_KEYLENGTH];
-        CryptoPP::SecByteBlock derived(64);
-        std::string saltString;
-        std::string ciphertext;
-
-        std::lock_guard<std::mutex> lock(*lgMutex);
-        generateSalt(saltString);
-
-        std::string plaintext = "int" + std::to_string(data);
-
-        plaintext += SHA512HashString(plaintext) + saltString;
-
-        initializeKeyAndIV(dataKey, key, iv);
-
-        encryptData(plaintext, ciphertext, key, iv);
-
-        createFile(module, dataKey.c_str(), ciphertext);
-
-        return 0;
+        return storeRecord(module, dataKey, encodeValue(VALUE_INT64, (uint64_t) data, sizeof(data)));
     }
 
     /**
@@ -1656,32 +5881,7 @@ namespace PISSD
      */
     int SecureDataStorage::storeDataToModule(std::string module, const std::string &dataKey, bool &data)
     {
-        CryptoPP::byte key[CryptoPP::AES::MAX_KEYLENGTH], iv[CryptoPP::AES::MAX_KEYLENGTH];
-        CryptoPP::SecByteBlock derived(64);
-        std::string saltString;
-        std::string ciphertext;
-
-        std::lock_guard<std::mutex> lock(*lgMutex);
-        generateSalt(saltString);
-
-        std::string plaintext = "bol";
-        if (data)
-        {
-            plaintext += "true";
-        } else
-        {
-            plaintext += "false";
-        }
-
-        plaintext += SHA512HashString(plaintext) + saltString;
-
-        initializeKeyAndIV(dataKey, key, iv);
-
-        encryptData(plaintext, ciphertext, key, iv);
-
-        createFile(module, dataKey.c_str(), ciphertext);
-
-        return 0;
+        return storeRecord(module, dataKey, encodeValue(VALUE_BOOL, data, 1));
     }
 
     /**
@@ -1693,66 +5893,13 @@ namespace PISSD
      */
     int SecureDataStorage::retrieveDataFromModule(std::string module, const std::string &dataKey, std::string &data)
     {
-        std::string dataToRead[3];
-        std::vector<std::string> possibleData;
-        bool carefulFlag = true;
-
-        std::lock_guard<std::mutex> lock(*lgMutex);
-
-        int loadedFileCheck = loadFile(module, dataToRead, dataKey);
-        if (loadedFileCheck == 0)
-        {
-            if (compareCiphertext(dataToRead) > 1)
-            {
-                carefulFlag = false;
-            }
-            std::string temp[3];
-            for (int i = 0; i < 3; ++i)
-            {
-                temp[i] = decrypthData(dataKey, dataToRead[i]);
-                if (checkHash(temp[i]) == 0)
-                {
-                    temp[i].erase(temp[i].end() - 90, temp[i].end());
-                    if (temp[i].substr(0, 3) == "str")
-                    {
-                        temp[i].erase(0, 3);
-                        possibleData.push_back(temp[i]);
-                    }
-                }
-            }
-        } else if (loadedFileCheck < 3)
-        {
-            std::string temp;
-            for (int i = 0; i < loadedFileCheck; ++i)
-            {
-                temp = decrypthData(dataKey, dataToRead[i]);
-                if (checkHash(temp) == 0)
-                {
-                    temp.erase(temp.end() - 90, temp.end());
-                    if (temp.substr(0, 3) == "str")
-                    {
-                        temp.erase(0, 3);
-                        possibleData.push_back(temp);
-                    }
-                }
-            }
-        }
-
-        if (loadedFileCheck == 3 || possibleData.empty())
+        int result = retrieveRecord(module, dataKey, VALUE_STRING, data);
+        if (result < 0)
         {
-            std::cerr << "No file found\n";
             data = "";
-            return -1;
-        }
-
-        data = findSameStrings(possibleData);
-
-        if (carefulFlag)
-        {
-            return 1;
         }
 
-        return 0;
+        return result;
     }
 
     /**
@@ -1764,65 +5911,17 @@ namespace PISSD
      */
     int SecureDataStorage::retrieveDataFromModule(std::string module, const std::string &dataKey, double &data)
     {
-        std::string dataToRead[3];
-        std::vector<std::string> possibleData;
-        bool carefulFlag = true;
-
-        std::lock_guard<std::mutex> lock(*lgMutex);
-
-        int loadedFileCheck = loadFile(module, dataToRead, dataKey);
-        if (loadedFileCheck == 0)
-        {
-            if (compareCiphertext(dataToRead) > 1)
-            {
-                carefulFlag = false;
-            }
-            std::string temp[3];
-            for (int i = 0; i < 3; ++i)
-            {
-                temp[i] = decrypthData(dataKey, dataToRead[i]);
-                if (checkHash(temp[i]) == 0)
-                {
-                    temp[i].erase(temp[i].end() - 90, temp[i].end());
-                    if (temp[i].substr(0, 3) == "dbl")
-                    {
-                        temp[i].erase(0, 3);
-                        possibleData.push_back(temp[i]);
-                    }
-                }
-            }
-        } else if (loadedFileCheck < 3)
-        {
-            std::string temp;
-            for (int i = 0; i < loadedFileCheck; ++i)
-            {
-                temp = decrypthData(dataKey, dataToRead[i]);
-                if (checkHash(temp) == 0)
-                {
-                    temp.erase(temp.end() - 90, temp.end());
-                    if (temp.substr(0, 3) == "dbl")
-                    {
-                        temp.erase(0, 3);
-                        possibleData.push_back(temp);
-                    }
-                }
-            }
-        }
-
-        if (loadedFileCheck == 3 || possibleData.empty())
+        std::string value;
+        int result = retrieveRecord(module, dataKey, VALUE_DOUBLE, value);
+        if (result < 0)
         {
-            std::cerr << "No file found\n";
-            return -1;
+            return result;
         }
 
-        data = std::stod(findSameStrings(possibleData));
-
-        if (carefulFlag)
-        {
-            return 1;
-        }
+        uint64_t bits = decodeValue(value);
+        memcpy(&data, &bits, sizeof(data));
 
-        return 0;
+        return result;
     }
 
     /**
@@ -1834,63 +5933,17 @@ namespace PISSD
      */
     int SecureDataStorage::retrieveDataFromModule(std::string module, const std::string &dataKey, float &data)
     {
-        std::string dataToRead[3];
-        std::vector<std::string> possibleData;
-        bool carefulFlag = true;
-
-        std::lock_guard<std::mutex> lock(*lgMutex);
-
-        int loadedFileCheck = loadFile(module, dataToRead, dataKey);
-        if (loadedFileCheck == 0)
-        {
-            if (compareCiphertext(dataToRead) > 1)
-            {
-                carefulFlag = false;
-            }
-            std::string temp[3];
-            for (int i = 0; i < 3; ++i)
-            {
-                temp[i] = decrypthData(dataKey, dataToRead[i]);
-                if (checkHash(temp[i]) == 0) {
-                    temp[i].erase(temp[i].end() - 90, temp[i].end());
-                    if (temp[i].substr(0, 3) == "flt") {
-                        temp[i].erase(0, 3);
-                        possibleData.push_back(temp[i]);
-                    }
-                }
-            }
-        } else if (loadedFileCheck < 3)
-        {
-            std::string temp;
-            for (int i = 0; i < loadedFileCheck; ++i)
-            {
-                temp = decrypthData(dataKey, dataToRead[i]);
-                if (checkHash(temp) == 0)
-                {
-                    temp.erase(temp.end() - 90, temp.end());
-                    if (temp.substr(0, 3) == "flt")
-                    {
-                        temp.erase(0, 3);
-                        possibleData.push_back(temp);
-                    }
-                }
-            }
-        }
-
-        if (loadedFileCheck == 3 || possibleData.empty())
+        std::string value;
+        int result = retrieveRecord(module, dataKey, VALUE_FLOAT, value);
+        if (result < 0)
         {
-            std::cerr << "No file found\n";
-            return -1;
+            return result;
         }
 
-        data = std::stof(findSameStrings(possibleData));
-
-        if (carefulFlag)
-        {
-            return 1;
-        }
+        uint32_t bits = (uint32_t) decodeValue(value);
+        memcpy(&data, &bits, sizeof(data));
 
-        return 0;
+        return result;
     }
 
     /**
@@ -1902,65 +5955,16 @@ namespace PISSD
      */
     int SecureDataStorage::retrieveDataFromModule(std::string module, const std::string &dataKey, int64_t &data)
     {
-        std::string dataToRead[3];
-        std::vector<std::string> possibleData;
-        bool carefulFlag = true;
-
-        std::lock_guard<std::mutex> lock(*lgMutex);
-
-        int loadedFileCheck = loadFile(module, dataToRead, dataKey);
-        if (loadedFileCheck == 0)
-        {
-            if (compareCiphertext(dataToRead) > 1)
-            {
-                carefulFlag = false;
-            }
-                std::string temp[3];
-                for (int i = 0; i < 3; ++i)
-                {
-                    temp[i] = decrypthData(dataKey, dataToRead[i]);
-                    if (checkHash(temp[i]) == 0)
-                    {
-                        temp[i].erase(temp[i].end() - 90, temp[i].end());
-                        if (temp[i].substr(0, 3) == "int")
-                        {
-                            temp[i].erase(0, 3);
-                            possibleData.push_back(temp[i]);
-                        }
-                    }
-                }
-        } else if (loadedFileCheck < 3)
-        {
-            std::string temp;
-            for (int i = 0; i < loadedFileCheck; ++i)
-            {
-                temp = decrypthData(dataKey, dataToRead[i]);
-                if (checkHash(temp) == 0)
-                {
-                    temp.erase(temp.end() - 90, temp.end());
-                    if (temp.substr(0, 3) == "int")
-                    {
-                        temp.erase(0, 3);
-                        possibleData.push_back(temp);
-                    }
-                }
-            }
-        }
-
-        if (loadedFileCheck == 3 || possibleData.empty())
+        std::string value;
+        int result = retrieveRecord(module, dataKey, VALUE_INT64, value);
+        if (result < 0)
         {
-            std::cerr << "No file found\n";
-            return -1;
+            return result;
         }
 
-        data = std::stoll(findSameStrings(possibleData));
-
-        if (carefulFlag)
-        {
-            return 1;
-        }
+        data = (int64_t) decodeValue(value);
 
-        return 0;
+        return result;
     }
 
     /**
@@ -1972,73 +5976,19 @@ namespace PISSD
      */
     int SecureDataStorage::retrieveDataFromModule(std::string module, const std::string &dataKey, bool &data)
     {
-        std::string dataToRead[3];
-        std::vector<std::string> possibleData;
-        bool carefulFlag = true;
-
-        std::lock_guard<std::mutex> lock(*lgMutex);
-
-        int loadedFileCheck = loadFile(module, dataToRead, dataKey);
-        if (loadedFileCheck == 0)
-        {
-            if (compareCiphertext(dataToRead) > 1)
-            {
-                carefulFlag = false;
-            }
-                std::string temp[3];
-                for (int i = 0; i < 3; ++i)
-                {
-                    temp[i] = decrypthData(dataKey, dataToRead[i]);
-                    if (checkHash(temp[i]) == 0)
-                    {
-                        temp[i].erase(temp[i].end() - 90, temp[i].end());
-                        if (temp[i].substr(0, 3) == "bol")
-                        {
-                            temp[i].erase(0, 3);
-                            possibleData.push_back(temp[i]);
-                        }
-                    }
-                }
-        } else if (loadedFileCheck < 3)
-        {
-            std::string temp;
-            for (int i = 0; i < loadedFileCheck; ++i)
-            {
-                temp = decrypthData(dataKey, dataToRead[i]);
-                if (checkHash(temp) == 0)
-                {
-                    temp.erase(temp.end() - 90, temp.end());
-                    if (temp.substr(0, 3) == "bol")
-                    {
-                        temp.erase(0, 3);
-                        possibleData.push_back(temp);
-                    }
-                }
-            }
-        }
-
-        if (loadedFileCheck == 3 || possibleData.empty())
+        std::string value;
+        int result = retrieveRecord(module, dataKey, VALUE_BOOL, value);
+        if (result < 0)
         {
-            std::cerr << "No file found\n";
-            return -1;
+            return result;
         }
 
-        if (findSameStrings(possibleData) == "true")
-        {
-            data = true;
-        } else if (findSameStrings(possibleData) == "false")
-        {
-            data = false;
-        } else
+        if (value[0] > 1)
         {
             return 2;
         }
+        data = value[0] == 1;
 
-        if (carefulFlag)
-        {
-            return 1;
-        }
-
-        return 0;
+        return result;
     }
 }
\ No newline at end of file
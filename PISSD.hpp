@@ -8,16 +8,194 @@
 #ifndef LIBPISSD_LIBRARY_H
 #define LIBPISSD_LIBRARY_H
 
+#include <string>
+#include <vector>
+#include <mutex>
+#include <cstdint>
+#include <memory>
+#include <atomic>
+#include <cryptopp/secblock.h>
+
 namespace PISSD
 {
+    class KeyCache;
+    class SaltPool;
+    class Scrubber;
+    class RootSet;
+
+    /// Layout of replicas in PISSD folders
+    enum class StorageEngine
+    {
+        /// Every key is a hidden file in each folder
+        Files,
+        /// Records are appended to segment files of each folder
+        Segments
+    };
+
+    /// What has to reach disk before store reports success
+    enum class Durability
+    {
+        /// Replicas are published atomically but may stay in cache of operating system
+        None,
+        /// Every replica is flushed before it is published
+        DataSync,
+        /// Replicas are flushed and folder of each of them is synced once it is published
+        DirectorySync
+    };
+
+    /// When and how fast segments are compacted
+    struct CompactionPolicy
+    {
+        /// Sealed segment is rewritten once this fraction of it is dead
+        double deadRatio = 0.5;
+        /// Active segment is sealed when it reaches this size
+        uint64_t segmentSize = 64 * 1024 * 1024;
+        /// Limit of bytes compactor reads and writes per second, zero for unlimited
+        uint64_t bytesPerSecond = 8 * 1024 * 1024;
+    };
+
+    /// Statistics of segment compaction over all replicas
+    struct CompactionStats
+    {
+        uint64_t liveBytes = 0;
+        uint64_t totalBytes = 0;
+        /// Bytes on disk per live byte
+        double spaceAmplification = 0;
+        uint64_t reclaimedBytes = 0;
+        /// Bytes read and written by compactor
+        uint64_t compactedBytes = 0;
+        uint64_t segmentsCompacted = 0;
+        /// Compacted bytes per second of compactor work, including throttling
+        double throughput = 0;
+    };
+
+    /// Reads of one replica folder
+    struct ReplicaStats
+    {
+        /// Moving average of read latency
+        uint64_t latencyMicroseconds = 0;
+        uint64_t reads = 0;
+        /// Reads that missed hedging deadline
+        uint64_t slowReads = 0;
+        /// Reads issued because the two fastest replicas missed deadline or did not agree
+        uint64_t hedgedReads = 0;
+    };
+
+    /// How fast and how often replicas are scrubbed
+    struct ScrubPolicy
+    {
+        /// Limit of bytes scrubber reads per second, zero for unlimited
+        uint64_t bytesPerSecond = 4 * 1024 * 1024;
+        /// Pause between two passes over all keys
+        uint32_t intervalSeconds = 24 * 60 * 60;
+    };
+
+    /// Progress of scrubber
+    struct ScrubProgress
+    {
+        /// Finished passes over all keys
+        uint64_t passes = 0;
+        /// Keys checked in current pass and number of keys it walks
+        uint64_t keysScrubbed = 0;
+        uint64_t keysTotal = 0;
+        uint64_t bytesScrubbed = 0;
+        /// Keys whose replicas differed, those with majority value get repaired
+        uint64_t divergentKeys = 0;
+        uint64_t repairedKeys = 0;
+        uint64_t unrepairableKeys = 0;
+        bool running = false;
+        bool paused = false;
+    };
+
     class SecureDataStorage
     {
     private:
-        std::mutex * lgMutex;
+        CryptoPP::SecByteBlock masterKey;
+        std::unique_ptr<KeyCache> keyCache;
+        std::unique_ptr<SaltPool> saltPool;
+        std::unique_ptr<Scrubber> scrubber;
+        std::shared_ptr<RootSet> shared;
+        StorageEngine engine;
+        std::atomic<Durability> durability;
+        std::atomic<int> writeQuorum;
+        std::atomic<uint32_t> hedgeDeadline;
+        bool groupCommitSet;
+        size_t groupCommitBatch;
+        uint32_t groupCommitWindow;
+        bool compactionPolicySet;
+        CompactionPolicy compactionPolicy;
+        std::string identity;
+        std::string rootPaths[3];
+        std::vector<std::string> pinnedRootPaths;
+        std::atomic<bool> opened;
+        std::atomic<uint64_t> retrieveMisses;
+        std::mutex openMutex;
+
+        int getRootPaths(std::string paths[]);
+        void ensureRootDirs();
+        void compactManifest();
+
+        int storeRecord(const std::string &module, const std::string &dataKey, const std::string &plaintext);
+        int retrieveRecord(const std::string &module, const std::string &dataKey, char type, std::string &data);
+        void repairRecord(const std::string &module, const std::string &dataKey, const std::string &record,
+                          const std::string data[], const bool loaded[]);
+        int scrubRecord(const std::string &module, const std::string &dataKey, uint64_t &bytes);
+        void runScrubber();
     public:
 
         /// Create instance of SecureDataStorage
+        SecureDataStorage();
         explicit SecureDataStorage(std::mutex *mMutex);
+        explicit SecureDataStorage(StorageEngine engine);
+        ~SecureDataStorage();
+
+        /// Resolve identity and storage folders, later operations reuse them
+        int open();
+
+        /// Use three caller chosen folders for replicas, must be called before open
+        int setRootPaths(const std::vector<std::string> &paths);
+
+        /// Limit number of keys whose derived key material stays cached
+        void setKeyCacheSize(size_t entries);
+
+        /// Statistics of key material cache
+        uint64_t getKeyCacheHits() const;
+        uint64_t getKeyCacheMisses() const;
+
+        /// Trade latency of writes for safety on crash
+        void setDurability(Durability level);
+
+        /// Let concurrent writers share syncs, the first of them waits up to window for the others
+        void setGroupCommit(size_t batchSize, uint32_t windowMicroseconds);
+        void getGroupCommitStats(uint64_t &groups, uint64_t &requests) const;
+
+        /// Return from store once quorum of replicas is written, the rest is written in background
+        int setWriteQuorum(int replicas);
+
+        /// Read the two fastest replicas and the third one only if they disagree or miss deadline
+        void setReadHedging(uint32_t deadlineMicroseconds);
+        void getReplicaStats(ReplicaStats stats[]);
+
+        /// Failed replica writes and keys whose replicas wait for repair
+        uint64_t getFailedReplicaWrites() const;
+        size_t getPendingRepairs() const;
+
+        /// Replicas rewritten in background because retrieve found them divergent or missing
+        uint64_t getReadRepairs() const;
+
+        /// Walk all keys in background, compare their replicas and repair divergent ones
+        void startScrubber(const ScrubPolicy &policy = ScrubPolicy());
+        void pauseScrubber();
+        void resumeScrubber();
+        ScrubProgress getScrubProgress();
+
+        /// Configure and observe compaction of segment engine
+        void setCompactionPolicy(const CompactionPolicy &policy);
+        CompactionStats getCompactionStats();
+
+        /// Number of retrieves of keys that do not exist
+        uint64_t getRetrieveMisses() const;
+
         /// Store data
         int storeData(const std::string &dataKey, std::string &data);
         int storeData(const std::string &dataKey, double &data);
@@ -25,7 +203,7 @@ namespace PISSD
         int storeData(const std::string &dataKey, int64_t &data);
         int storeData(const std::string &dataKey, bool &data);
 
-        /// Get stored data back
+        /// Get stored data back, -1 is returned if key does not exist and -2 if no replica can be read
         int retrieveData(const std::string &dataKey, std::string &data);
         int retrieveData(const std::string &dataKey, double &data);
         int retrieveData(const std::string &dataKey, float &data);
@@ -82,6 +260,34 @@ namespace PISSD
 
         /// Return true if demanded key exists
         bool contains(const std::string &dataKey);
+
+        /// Return one page of module and key pairs in particular module and its submodules
+        int listKeys(const std::string &module, size_t pageSize, std::string &resumeToken,
+                     std::vector<std::pair<std::string, std::string>> &entries);
+    };
+
+    /// Iterate keys of a module page by page
+    class KeyCursor
+    {
+    private:
+        SecureDataStorage &storage;
+        std::string module;
+        size_t pageSize;
+        std::string nextToken;
+        std::vector<std::pair<std::string, std::string>> page;
+        size_t position;
+        bool finished;
+
+    public:
+        /// Create cursor, it can continue where another cursor stopped by its resume token
+        KeyCursor(SecureDataStorage &storage, const std::string &module, size_t pageSize,
+                  const std::string &resumeToken = "");
+
+        /// Return next key, false when there are no more keys
+        bool next(std::string &module, std::string &key);
+
+        /// Return token that resumes listing after the last returned key
+        std::string getResumeToken() const;
     };
 }
 #endif
\ No newline at end of file
@@ -0,0 +1,194 @@
+/**
+*  @file    PISSD_bench.cpp
+*  @date    16/10/2026
+*  @version 1.0
+*/
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+
+#include "../PISSD.hpp"
+
+typedef std::chrono::steady_clock Clock;
+
+std::string benchRoot = "/tmp/PISSD_bench";
+
+/**
+ * Open storage in bench folders, so bench never touches folders of the user
+ * @param secureDataStorage is instance that will be opened
+ */
+void openBenchStorage(PISSD::SecureDataStorage &secureDataStorage)
+{
+    secureDataStorage.setRootPaths({benchRoot + "_0", benchRoot + "_1", benchRoot + "_2"});
+    if (secureDataStorage.open() != 0)
+    {
+        std::cerr << "Cannot open storage in " << benchRoot << "_*" << std::endl;
+        exit(1);
+    }
+}
+
+/**
+ * Time one call in microseconds
+ */
+template<class F>
+double timeCall(F call)
+{
+    auto start = Clock::now();
+    call();
+
+    return std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+}
+
+/**
+ * Print percentiles of samples in microseconds
+ */
+void printLatency(const std::string &name, std::vector<double> samples)
+{
+    std::sort(samples.begin(), samples.end());
+    auto at = [&samples](double quantile) { return samples[(size_t) (quantile * (samples.size() - 1))]; };
+
+    std::cout << std::left << std::setw(28) << name << std::right << std::fixed << std::setprecision(1)
+              << " p50 " << std::setw(9) << at(0.5) << " us  p99 " << std::setw(9) << at(0.99)
+              << " us  max " << std::setw(9) << samples.back() << " us" << std::endl;
+}
+
+/**
+ * Stores and retrieves of distinct keys from 1 to 32 threads
+ * @param seconds is duration of each step
+ */
+void benchContention(double seconds)
+{
+    PISSD::SecureDataStorage secureDataStorage;
+    openBenchStorage(secureDataStorage);
+
+    std::cout << "contention: store and retrieve of own key per thread" << std::endl;
+    for (int threads = 1; threads <= 32; threads *= 2)
+    {
+        std::atomic<uint64_t> operations(0);
+        std::atomic<bool> stop(false);
+        std::vector<std::thread> workers;
+        for (int i = 0; i < threads; ++i)
+        {
+            workers.emplace_back([&secureDataStorage, &operations, &stop, i]
+            {
+                std::string dataKey = "Contention" + std::to_string(i);
+                for (int64_t j = 0; !stop; ++j)
+                {
+                    int64_t data = j;
+                    secureDataStorage.storeData(dataKey, data);
+                    secureDataStorage.retrieveData(dataKey, data);
+                    operations += 2;
+                }
+            });
+        }
+
+        std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+        stop = true;
+        for (auto &worker : workers)
+        {
+            worker.join();
+        }
+        std::cout << std::setw(4) << threads << " threads " << std::setw(10) << std::fixed << std::setprecision(0)
+                  << operations / seconds << " ops/s" << std::endl;
+    }
+    secureDataStorage.deleteAllData();
+}
+
+/**
+ * Latency of the first operation of new instance and of later ones
+ * @param samples is number of later operations
+ */
+void benchFirstOperation(int samples)
+{
+    std::string data = "Bench";
+    std::string dataKey = "FirstOperation";
+    std::vector<double> first, steady;
+    for (int i = 0; i < 20; ++i)
+    {
+        PISSD::SecureDataStorage secureDataStorage;
+        secureDataStorage.setRootPaths({benchRoot + "_0", benchRoot + "_1", benchRoot + "_2"});
+        first.push_back(timeCall([&] { secureDataStorage.retrieveData(dataKey, data); }));
+        if (i == 0)
+        {
+            secureDataStorage.storeData(dataKey, data);
+            for (int j = 0; j < samples; ++j)
+            {
+                steady.push_back(timeCall([&] { secureDataStorage.retrieveData(dataKey, data); }));
+            }
+        }
+    }
+
+    std::cout << "first operation: retrieve of new instance versus later retrieves" << std::endl;
+    printLatency("first", first);
+    printLatency("steady", steady);
+
+    PISSD::SecureDataStorage secureDataStorage;
+    openBenchStorage(secureDataStorage);
+    secureDataStorage.deleteAllData();
+}
+
+/**
+ * Store and retrieve latency of small value, every durability level and both engines
+ * @param samples is number of operations of each kind
+ */
+void benchLatency(int samples)
+{
+    PISSD::StorageEngine engines[] = {PISSD::StorageEngine::Files, PISSD::StorageEngine::Segments};
+    const char *engineNames[] = {"files", "segments"};
+    PISSD::Durability levels[] = {PISSD::Durability::None, PISSD::Durability::DataSync,
+                                  PISSD::Durability::DirectorySync};
+    const char *levelNames[] = {"none", "datasync", "dirsync"};
+
+    std::cout << "latency: 16 byte string, " << samples << " operations each" << std::endl;
+    for (int e = 0; e < 2; ++e)
+    {
+        PISSD::SecureDataStorage secureDataStorage(engines[e]);
+        openBenchStorage(secureDataStorage);
+        for (int l = 0; l < 3; ++l)
+        {
+            secureDataStorage.setDurability(levels[l]);
+            std::vector<double> stores, retrieves;
+            for (int i = 0; i < samples; ++i)
+            {
+                std::string data = "0123456789abcdef";
+                std::string dataKey = "Latency" + std::to_string(i % 64);
+                stores.push_back(timeCall([&] { secureDataStorage.storeData(dataKey, data); }));
+                retrieves.push_back(timeCall([&] { secureDataStorage.retrieveData(dataKey, data); }));
+            }
+            std::string name = std::string(engineNames[e]) + " " + levelNames[l];
+            printLatency(name + " store", stores);
+            printLatency(name + " retrieve", retrieves);
+        }
+        secureDataStorage.deleteAllData();
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    std::string scenario = argc > 1 ? argv[1] : "all";
+    if (argc > 2)
+    {
+        benchRoot = argv[2];
+    }
+
+    if (scenario == "contention" || scenario == "all")
+    {
+        benchContention(2.0);
+    }
+    if (scenario == "first" || scenario == "all")
+    {
+        benchFirstOperation(1000);
+    }
+    if (scenario == "latency" || scenario == "all")
+    {
+        benchLatency(2000);
+    }
+
+    return 0;
+}
@@ -5,12 +5,20 @@
 *  @version 1.0
 */
 #include <iostream>
+#include <fstream>
 #include <algorithm>
 #include <vector>
 #include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
 #include <sys/stat.h>
 #include <unistd.h>
 
+#ifdef __linux__
+#include <sys/wait.h>
+#endif
+
 #ifdef WIN32
 #include <Shlobj.h>
 #include <Shlwapi.h>
@@ -41,17 +49,42 @@ void getPath(std::string &path)
     std::string homePath = getenv("HOME");
     path = homePath + "/.config/.PISSD";
 #endif
+#ifdef __linux__
+    const char *dataHome = getenv("XDG_DATA_HOME");
+    if (dataHome != nullptr && dataHome[0] == '/')
+    {
+        path = std::string(dataHome) + "/PISSD";
+    } else
+    {
+        path = std::string(getenv("HOME")) + "/.local/share/PISSD";
+    }
+#endif
 }
 
 
+// Store returns once majority of replicas is written, the checked one may still be written in background
+bool replicaExists(const std::string &path)
+{
+    struct stat info;
+    for (int i = 0; i < 50; ++i)
+    {
+        if (stat(path.c_str(), &info) == 0)
+        {
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    return false;
+}
+
 bool fileExists(std::string dataKey)
 {
     std::string path;
     getPath(path);
     path += "/." + dataKey + ".jkl";
 
-    struct stat info;
-    return (stat (path.c_str(), &info) == 0);
+    return replicaExists(path);
 }
 
 bool folderExists(std::string module)
@@ -80,11 +113,19 @@ bool folderWithFileExists(std::string dataKey, std::string modulePath) {
     getPath(path);
     path += "/" + modulePath + "/." + dataKey + ".jkl";
 
-    struct stat info;
-    return (stat(path.c_str(), &info) == 0);
+    return replicaExists(path);
 }
 
 
+TEST_CASE("Open Storage")
+{
+    PISSD::SecureDataStorage secureDataStorage(&mutex);
+
+    REQUIRE(secureDataStorage.open() == 0);
+    REQUIRE(folderExists(""));
+    REQUIRE(secureDataStorage.open() == 0);
+}
+
 TEST_CASE("Store and Retrieve String")
 {
     PISSD::SecureDataStorage secureDataStorage(&mutex);
@@ -133,6 +174,31 @@ TEST_CASE("Store and Retrieve Int64")
     REQUIRE(data == 42);
 }
 
+TEST_CASE("Store and Retrieve Precise Numbers")
+{
+    PISSD::SecureDataStorage secureDataStorage(&mutex);
+
+    std::string dataKey = "Test";
+
+    double doubleData = 0.1 + 0.2;
+    double doubleOutput = 0;
+    REQUIRE(secureDataStorage.storeData(dataKey, doubleData) == 0);
+    REQUIRE(secureDataStorage.retrieveData(dataKey, doubleOutput) == 0);
+    REQUIRE(doubleOutput == doubleData);
+
+    float floatData = 1.0f / 3.0f;
+    float floatOutput = 0;
+    REQUIRE(secureDataStorage.storeData(dataKey, floatData) == 0);
+    REQUIRE(secureDataStorage.retrieveData(dataKey, floatOutput) == 0);
+    REQUIRE(floatOutput == floatData);
+
+    int64_t intData = INT64_MIN;
+    int64_t intOutput = 0;
+    REQUIRE(secureDataStorage.storeData(dataKey, intData) == 0);
+    REQUIRE(secureDataStorage.retrieveData(dataKey, intOutput) == 0);
+    REQUIRE(intOutput == intData);
+}
+
 TEST_CASE("Store and Retrieve Bool")
 {
     PISSD::SecureDataStorage secureDataStorage(&mutex);
@@ -160,6 +226,581 @@ TEST_CASE("Store and Retrieve Bool")
     }
 }
 
+TEST_CASE("Key Cache")
+{
+    PISSD::SecureDataStorage secureDataStorage(&mutex);
+
+    std::string data = "Unit test";
+    std::string dataKey = "Test";
+    REQUIRE(secureDataStorage.storeData(dataKey, data) == 0);
+    REQUIRE(secureDataStorage.getKeyCacheMisses() == 1);
+    REQUIRE(secureDataStorage.retrieveData(dataKey, data) == 0);
+    REQUIRE(secureDataStorage.getKeyCacheHits() == 1);
+
+    secureDataStorage.setKeyCacheSize(0);
+    REQUIRE(secureDataStorage.retrieveData(dataKey, data) == 0);
+    REQUIRE(secureDataStorage.getKeyCacheMisses() == 2);
+    REQUIRE(data == "Unit test");
+}
+
+TEST_CASE("Concurrent Store and Retrieve")
+{
+    PISSD::SecureDataStorage secureDataStorage;
+    std::atomic<int> failures(0);
+    std::vector<std::thread> threads;
+
+    for (int i = 0; i < 8; ++i)
+    {
+        threads.emplace_back([&secureDataStorage, &failures, i]
+        {
+            std::string dataKey = "Thread" + std::to_string(i);
+            for (int64_t j = 0; j < 20; ++j)
+            {
+                int64_t data = j * i;
+                int64_t outputData = -1;
+                if (secureDataStorage.storeData(dataKey, data) != 0
+                    || secureDataStorage.retrieveData(dataKey, outputData) != 0 || outputData != data)
+                {
+                    failures++;
+                }
+            }
+            secureDataStorage.deleteStoredData(dataKey);
+        });
+    }
+
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+    REQUIRE(failures == 0);
+}
+
+TEST_CASE("Instances Share Folders")
+{
+    PISSD::SecureDataStorage firstStorage(&mutex);
+    PISSD::SecureDataStorage secondStorage(&mutex);
+    PISSD::SecureDataStorage *storages[] = {&firstStorage, &secondStorage};
+    std::atomic<int> failures(0);
+    std::vector<std::thread> threads;
+
+    std::string dataKey = "SharedTest";
+    for (auto storage : storages)
+    {
+        threads.emplace_back([storage, &failures, &dataKey]
+        {
+            for (int64_t i = 0; i < 20; ++i)
+            {
+                if (storage->storeData(dataKey, i) != 0)
+                {
+                    failures++;
+                }
+            }
+        });
+    }
+
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+    REQUIRE(failures == 0);
+
+    int64_t data = -1;
+    REQUIRE(firstStorage.retrieveData(dataKey, data) == 0);
+    REQUIRE(data == 19);
+    REQUIRE(secondStorage.retrieveData(dataKey, data) == 0);
+    REQUIRE(data == 19);
+
+    secondStorage.deleteStoredData(dataKey);
+    REQUIRE_FALSE(firstStorage.contains(dataKey));
+}
+
+TEST_CASE("Contains Key")
+{
+    PISSD::SecureDataStorage secureDataStorage(&mutex);
+
+    std::string data = "Unit test";
+    std::string dataKey = "ContainsTest";
+    REQUIRE_FALSE(secureDataStorage.contains(dataKey));
+    REQUIRE(secureDataStorage.storeData(dataKey, data) == 0);
+    REQUIRE(secureDataStorage.contains(dataKey));
+    secureDataStorage.deleteStoredData(dataKey);
+    REQUIRE_FALSE(secureDataStorage.contains(dataKey));
+}
+
+TEST_CASE("Retrieve Missing Key")
+{
+    PISSD::SecureDataStorage secureDataStorage(&mutex);
+
+    std::string data = "Unit test";
+    REQUIRE(secureDataStorage.retrieveData("MissingTest", data) == -1);
+    REQUIRE(data.empty());
+    REQUIRE(secureDataStorage.getRetrieveMisses() == 1);
+    REQUIRE(secureDataStorage.getKeyCacheMisses() == 0);
+}
+
+TEST_CASE("Key Stored by Another Instance")
+{
+    PISSD::SecureDataStorage secureDataStorage(&mutex);
+    REQUIRE(secureDataStorage.open() == 0);
+
+    std::string data = "Unit test";
+    std::string outputData;
+    std::string dataKey = "OtherInstanceTest";
+    REQUIRE_FALSE(secureDataStorage.contains(dataKey));
+    {
+        PISSD::SecureDataStorage otherStorage(&mutex);
+        REQUIRE(otherStorage.storeData(dataKey, data) == 0);
+    }
+
+    REQUIRE(secureDataStorage.contains(dataKey));
+    REQUIRE(secureDataStorage.retrieveData(dataKey, outputData) == 0);
+    REQUIRE(outputData == data);
+    REQUIRE(secureDataStorage.getRetrieveMisses() == 0);
+    secureDataStorage.deleteStoredData(dataKey);
+}
+
+TEST_CASE("Reopen Storage")
+{
+    std::string data = "Unit test";
+    std::string dataKey = "ReopenTest";
+    {
+        PISSD::SecureDataStorage secureDataStorage;
+        REQUIRE(secureDataStorage.storeData(dataKey, data) == 0);
+    }
+
+    PISSD::SecureDataStorage secureDataStorage;
+    REQUIRE(secureDataStorage.contains(dataKey));
+    secureDataStorage.deleteStoredData(dataKey);
+
+    PISSD::SecureDataStorage reopenedStorage;
+    REQUIRE_FALSE(reopenedStorage.contains(dataKey));
+}
+
+TEST_CASE("Segment Engine")
+{
+    std::string data = "Unit test";
+    std::string outputData;
+    std::string fileKey = "SegmentImportTest";
+    std::string dataKey = "SegmentTest";
+    {
+        PISSD::SecureDataStorage fileStorage(PISSD::StorageEngine::Files);
+        REQUIRE(fileStorage.storeData(fileKey, data) == 0);
+    }
+
+    {
+        PISSD::SecureDataStorage secureDataStorage(PISSD::StorageEngine::Segments);
+        REQUIRE(secureDataStorage.retrieveData(fileKey, outputData) == 0);
+        REQUIRE(outputData == data);
+        REQUIRE_FALSE(fileExists(fileKey));
+
+        REQUIRE(secureDataStorage.storeData(dataKey, data) == 0);
+        REQUIRE(secureDataStorage.storeData(dataKey, data) == 0);
+        REQUIRE_FALSE(fileExists(dataKey));
+    }
+
+    PISSD::SecureDataStorage secureDataStorage(PISSD::StorageEngine::Segments);
+    outputData.clear();
+    REQUIRE(secureDataStorage.retrieveData(dataKey, outputData) == 0);
+    REQUIRE(outputData == data);
+    secureDataStorage.deleteStoredData(dataKey);
+    secureDataStorage.deleteStoredData(fileKey);
+    REQUIRE(secureDataStorage.retrieveData(dataKey, outputData) == -1);
+
+    {
+        PISSD::SecureDataStorage fileStorage(PISSD::StorageEngine::Files);
+        REQUIRE(fileStorage.open() != 0);
+        REQUIRE(fileStorage.storeData(fileKey, data) != 0);
+    }
+
+    // Segment engine owns roots until they are wiped, later tests use file engine
+    secureDataStorage.deleteAllData();
+}
+
+TEST_CASE("Segment Compaction")
+{
+    PISSD::SecureDataStorage secureDataStorage(PISSD::StorageEngine::Segments);
+    PISSD::CompactionPolicy policy;
+    policy.segmentSize = 512;
+    policy.bytesPerSecond = 0;
+    secureDataStorage.setCompactionPolicy(policy);
+
+    std::string dataKey = "CompactionTest";
+    for (int64_t i = 0; i < 100; ++i)
+    {
+        REQUIRE(secureDataStorage.storeData(dataKey, i) == 0);
+    }
+
+    for (int i = 0; i < 50 && secureDataStorage.getCompactionStats().segmentsCompacted == 0; ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    REQUIRE(secureDataStorage.getCompactionStats().segmentsCompacted > 0);
+    REQUIRE(secureDataStorage.getCompactionStats().reclaimedBytes > 0);
+
+    int64_t data = -1;
+    REQUIRE(secureDataStorage.retrieveData(dataKey, data) == 0);
+    REQUIRE(data == 99);
+    secureDataStorage.deleteStoredData(dataKey);
+    secureDataStorage.deleteAllData();
+}
+
+TEST_CASE("Durability Levels")
+{
+    PISSD::Durability levels[] = {PISSD::Durability::None, PISSD::Durability::DataSync,
+                                  PISSD::Durability::DirectorySync};
+    PISSD::StorageEngine engines[] = {PISSD::StorageEngine::Files, PISSD::StorageEngine::Segments};
+
+    for (auto engine : engines)
+    {
+        PISSD::SecureDataStorage secureDataStorage(engine);
+        for (auto level : levels)
+        {
+            std::string data = "Unit test";
+            std::string dataKey = "DurabilityTest";
+            secureDataStorage.setDurability(level);
+            REQUIRE(secureDataStorage.storeData(dataKey, data) == 0);
+            data.clear();
+            REQUIRE(secureDataStorage.retrieveData(dataKey, data) == 0);
+            REQUIRE(data == "Unit test");
+            secureDataStorage.deleteStoredData(dataKey);
+        }
+
+        if (engine == PISSD::StorageEngine::Segments)
+        {
+            secureDataStorage.deleteAllData();
+        }
+    }
+}
+
+TEST_CASE("Group Commit")
+{
+    PISSD::SecureDataStorage secureDataStorage;
+    secureDataStorage.setDurability(PISSD::Durability::DataSync);
+    secureDataStorage.setGroupCommit(8, 500);
+    std::atomic<int> failures(0);
+    std::vector<std::thread> threads;
+
+    for (int i = 0; i < 8; ++i)
+    {
+        threads.emplace_back([&secureDataStorage, &failures, i]
+        {
+            std::string dataKey = "GroupCommit" + std::to_string(i);
+            for (int64_t j = 0; j < 10; ++j)
+            {
+                if (secureDataStorage.storeData(dataKey, j) != 0)
+                {
+                    failures++;
+                }
+            }
+            secureDataStorage.deleteStoredData(dataKey);
+        });
+    }
+
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+
+    uint64_t groups, requests;
+    secureDataStorage.getGroupCommitStats(groups, requests);
+    REQUIRE(failures == 0);
+    REQUIRE(groups > 0);
+    REQUIRE(groups <= requests);
+}
+
+TEST_CASE("Hedged Reads")
+{
+    PISSD::SecureDataStorage secureDataStorage;
+    secureDataStorage.setReadHedging(1000000);
+
+    // Replica files are changed directly, so store has to wait until every replica is written
+    secureDataStorage.setWriteQuorum(3);
+
+    std::string data = "Unit test";
+    std::string outputData;
+    std::string dataKey = "HedgeTest";
+    REQUIRE(secureDataStorage.storeData(dataKey, data) == 0);
+    for (int i = 0; i < 100; ++i)
+    {
+        REQUIRE(secureDataStorage.retrieveData(dataKey, outputData) == 0);
+        REQUIRE(outputData == data);
+    }
+
+    // Agreeing replicas are enough, the third one is never read
+    PISSD::ReplicaStats stats[3];
+    secureDataStorage.getReplicaStats(stats);
+    REQUIRE(stats[0].reads + stats[1].reads + stats[2].reads == 200);
+    REQUIRE(stats[0].hedgedReads + stats[1].hedgedReads + stats[2].hedgedReads == 0);
+
+    std::string path;
+    getPath(path);
+    {
+        std::ofstream damaged(path + "/." + dataKey + ".jkl", std::ios::binary | std::ios::trunc);
+        damaged << "Damaged";
+    }
+    secureDataStorage.setReadHedging(0);
+    outputData.clear();
+    REQUIRE(secureDataStorage.retrieveData(dataKey, outputData) == 1);
+    REQUIRE(outputData == data);
+    secureDataStorage.getReplicaStats(stats);
+    REQUIRE(stats[0].reads + stats[1].reads + stats[2].reads == 203);
+    REQUIRE(stats[0].latencyMicroseconds + stats[1].latencyMicroseconds + stats[2].latencyMicroseconds > 0);
+    secureDataStorage.deleteStoredData(dataKey);
+}
+
+TEST_CASE("Read Repair")
+{
+    PISSD::SecureDataStorage secureDataStorage;
+    secureDataStorage.setReadHedging(0);
+
+    // Replica files are changed directly, so store has to wait until every replica is written
+    secureDataStorage.setWriteQuorum(3);
+
+    std::string data = "Unit test";
+    std::string outputData;
+    std::string dataKey = "RepairTest";
+    REQUIRE(secureDataStorage.storeData(dataKey, data) == 0);
+
+    std::string path;
+    getPath(path);
+    REQUIRE(remove((path + "/." + dataKey + ".jkl").c_str()) == 0);
+    REQUIRE(secureDataStorage.retrieveData(dataKey, outputData) == 1);
+    REQUIRE(outputData == data);
+
+    for (int i = 0; i < 50 && secureDataStorage.getReadRepairs() == 0; ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    REQUIRE(secureDataStorage.getReadRepairs() == 1);
+    REQUIRE(fileExists(dataKey));
+    outputData.clear();
+    REQUIRE(secureDataStorage.retrieveData(dataKey, outputData) == 0);
+    REQUIRE(outputData == data);
+    secureDataStorage.deleteStoredData(dataKey);
+}
+
+TEST_CASE("Replica Scrubber")
+{
+    PISSD::SecureDataStorage secureDataStorage;
+    secureDataStorage.setReadHedging(0);
+
+    // Replica files are changed directly, so store has to wait until every replica is written
+    secureDataStorage.setWriteQuorum(3);
+
+    std::string data = "Unit test";
+    std::string outputData;
+    for (int i = 0; i < 3; ++i)
+    {
+        REQUIRE(secureDataStorage.storeData("ScrubTest" + std::to_string(i), data) == 0);
+    }
+
+    std::string path;
+    getPath(path);
+    {
+        std::ofstream damaged(path + "/.ScrubTest1.jkl", std::ios::binary | std::ios::trunc);
+        damaged << "Damaged";
+    }
+
+    PISSD::ScrubPolicy policy;
+    policy.bytesPerSecond = 0;
+    secureDataStorage.startScrubber(policy);
+    for (int i = 0; i < 50 && secureDataStorage.getScrubProgress().passes == 0; ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+
+    PISSD::ScrubProgress progress = secureDataStorage.getScrubProgress();
+    REQUIRE(progress.running);
+    REQUIRE(progress.passes == 1);
+    REQUIRE(progress.keysScrubbed == progress.keysTotal);
+    REQUIRE(progress.keysTotal >= 3);
+    REQUIRE(progress.repairedKeys == 1);
+    REQUIRE(progress.unrepairableKeys == 0);
+
+    for (int i = 0; i < 50 && secureDataStorage.getReadRepairs() == 0; ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    REQUIRE(secureDataStorage.retrieveData("ScrubTest1", outputData) == 0);
+    REQUIRE(outputData == data);
+
+    secureDataStorage.pauseScrubber();
+    REQUIRE(secureDataStorage.getScrubProgress().paused);
+    secureDataStorage.resumeScrubber();
+    REQUIRE_FALSE(secureDataStorage.getScrubProgress().paused);
+    for (int i = 0; i < 3; ++i)
+    {
+        std::string dataKey = "ScrubTest" + std::to_string(i);
+        secureDataStorage.deleteStoredData(dataKey);
+    }
+}
+
+#ifndef WIN32
+TEST_CASE("Pinned Root Paths")
+{
+    std::vector<std::string> roots = {"/tmp/PISSD_unit_test_0", "/tmp/PISSD_unit_test_1", "/tmp/PISSD_unit_test_2"};
+    PISSD::SecureDataStorage secureDataStorage;
+    REQUIRE(secureDataStorage.setRootPaths({roots[0], roots[0], roots[1]}) != 0);
+    REQUIRE(secureDataStorage.setRootPaths({roots[0], roots[0] + "/", roots[1]}) != 0);
+    REQUIRE(secureDataStorage.setRootPaths({roots[0], "/tmp/../tmp/PISSD_unit_test_0", roots[1]}) != 0);
+    REQUIRE(secureDataStorage.setRootPaths(roots) == 0);
+
+    std::string data = "Unit test";
+    std::string dataKey = "PinnedTest";
+    REQUIRE(secureDataStorage.storeData(dataKey, data) == 0);
+    REQUIRE(secureDataStorage.setRootPaths(roots) != 0);
+    for (auto &root : roots)
+    {
+        REQUIRE(replicaExists(root + "/." + dataKey + ".jkl"));
+    }
+    secureDataStorage.deleteAllData();
+}
+
+TEST_CASE("Stale Temporary Replicas")
+{
+    // Temporary replica of crashed process is removed, the one of running process is kept
+    std::vector<std::string> roots = {"/tmp/PISSD_unit_test_0", "/tmp/PISSD_unit_test_1", "/tmp/PISSD_unit_test_2"};
+    mkdir(roots[0].c_str(), 0700);
+    std::string stale = roots[0] + "/.StaleTest.jkl.999999999-0.tmp";
+    std::string running = roots[0] + "/.StaleTest.jkl." + std::to_string(getpid()) + "-999999.tmp";
+    std::ofstream(stale) << "Unit test";
+    std::ofstream(running) << "Unit test";
+
+    PISSD::SecureDataStorage secureDataStorage;
+    REQUIRE(secureDataStorage.setRootPaths(roots) == 0);
+    REQUIRE(secureDataStorage.open() == 0);
+    bool removed = false;
+    struct stat info;
+    for (int i = 0; i < 50 && !removed; ++i)
+    {
+        removed = stat(stale.c_str(), &info) != 0;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    REQUIRE(removed);
+    REQUIRE(stat(running.c_str(), &info) == 0);
+    secureDataStorage.deleteAllData();
+}
+
+#ifdef __linux__
+TEST_CASE("Colliding Default Folders")
+{
+    // Config home pointing to data home would put two replicas into the same folder
+    const char *configHome = getenv("XDG_CONFIG_HOME");
+    std::string savedConfigHome = configHome != nullptr ? configHome : "";
+    std::string path;
+    getPath(path);
+    setenv("XDG_CONFIG_HOME", path.substr(0, path.size() - 6).c_str(), 1);
+
+    PISSD::SecureDataStorage secureDataStorage;
+    REQUIRE(secureDataStorage.open() != 0);
+    setenv("XDG_CONFIG_HOME", savedConfigHome.c_str(), 1);
+    REQUIRE(secureDataStorage.open() == 0);
+}
+
+TEST_CASE("Folders of Another Process", "[.]")
+{
+    // Run by test below in a second process
+    PISSD::SecureDataStorage secureDataStorage;
+    REQUIRE(secureDataStorage.setRootPaths({"/tmp/PISSD_unit_test_0", "/tmp/PISSD_unit_test_1",
+                                            "/tmp/PISSD_unit_test_2"}) == 0);
+    REQUIRE(secureDataStorage.open() != 0);
+}
+
+TEST_CASE("Folders Locked Against Other Processes")
+{
+    PISSD::SecureDataStorage secureDataStorage;
+    REQUIRE(secureDataStorage.setRootPaths({"/tmp/PISSD_unit_test_0", "/tmp/PISSD_unit_test_1",
+                                            "/tmp/PISSD_unit_test_2"}) == 0);
+    REQUIRE(secureDataStorage.open() == 0);
+
+    pid_t child = fork();
+    REQUIRE(child >= 0);
+    if (child == 0)
+    {
+        execl("/proc/self/exe", "PISSD_unit_tests", "Folders of Another Process", (char *) nullptr);
+        _exit(127);
+    }
+    int status;
+    REQUIRE(waitpid(child, &status, 0) == child);
+    REQUIRE(WIFEXITED(status));
+    REQUIRE(WEXITSTATUS(status) == 0);
+    secureDataStorage.deleteAllData();
+}
+#endif
+
+TEST_CASE("Journal Newer Than Manifest")
+{
+    std::vector<std::string> roots = {"/tmp/PISSD_unit_test_0", "/tmp/PISSD_unit_test_1", "/tmp/PISSD_unit_test_2"};
+    std::string data = "Unit test";
+    std::string dataKey = "JournalTest";
+    {
+        PISSD::SecureDataStorage secureDataStorage;
+        REQUIRE(secureDataStorage.setRootPaths(roots) == 0);
+        REQUIRE(secureDataStorage.storeData(dataKey, data) == 0);
+    }
+
+    // Journal of later generation follows snapshot that never reached disk, folders have to be scanned
+    for (auto &root : roots)
+    {
+        std::fstream journal(root + "/.manifest.log", std::ios::in | std::ios::out | std::ios::binary);
+        REQUIRE(journal);
+        journal.seekp(11);
+        journal.put(1);
+    }
+
+    PISSD::SecureDataStorage secureDataStorage;
+    REQUIRE(secureDataStorage.setRootPaths(roots) == 0);
+    REQUIRE(secureDataStorage.contains(dataKey));
+    secureDataStorage.deleteAllData();
+}
+
+TEST_CASE("Write Quorum")
+{
+    std::vector<std::string> roots = {"/tmp/PISSD_unit_test_0", "/tmp/PISSD_unit_test_1", "/tmp/PISSD_unit_test_2"};
+    PISSD::SecureDataStorage secureDataStorage;
+    REQUIRE(secureDataStorage.setRootPaths(roots) == 0);
+    REQUIRE(secureDataStorage.setWriteQuorum(1) != 0);
+
+    // Module folder missing in one root makes its replica fail
+    REQUIRE(secureDataStorage.createModule("", "QuorumModule") == 0);
+    REQUIRE(rmdir((roots[2] + "/QuorumModule").c_str()) == 0);
+    int64_t data = 0;
+    REQUIRE(secureDataStorage.setWriteQuorum(3) == 0);
+    REQUIRE(secureDataStorage.storeDataToModule("QuorumModule", "QuorumTest", data) != 0);
+    REQUIRE(secureDataStorage.getFailedReplicaWrites() == 1);
+    REQUIRE(secureDataStorage.getPendingRepairs() == 0);
+    REQUIRE(secureDataStorage.retrieveDataFromModule("QuorumModule", "QuorumTest", data) == -1);
+
+    // Majority is enough by default, the failing replica is left for repair
+    PISSD::SecureDataStorage defaultStorage;
+    REQUIRE(defaultStorage.setRootPaths(roots) == 0);
+    REQUIRE(defaultStorage.storeDataToModule("QuorumModule", "QuorumTest", data) == 0);
+    for (int i = 0; i < 50 && secureDataStorage.getFailedReplicaWrites() < 2; ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    REQUIRE(secureDataStorage.getFailedReplicaWrites() == 2);
+    REQUIRE(secureDataStorage.getPendingRepairs() == 1);
+
+    REQUIRE(secureDataStorage.setWriteQuorum(2) == 0);
+    REQUIRE(secureDataStorage.createModule("", "QuorumModule") == 0);
+    for (data = 1; data <= 20; ++data)
+    {
+        REQUIRE(secureDataStorage.storeDataToModule("QuorumModule", "QuorumTest", data) == 0);
+        int64_t retrieved;
+        REQUIRE(secureDataStorage.retrieveDataFromModule("QuorumModule", "QuorumTest", retrieved) >= 0);
+        REQUIRE(retrieved == data);
+    }
+
+    // Lanes write in order, so once all replicas of the last write are done the repair is gone
+    REQUIRE(secureDataStorage.setWriteQuorum(3) == 0);
+    REQUIRE(secureDataStorage.storeDataToModule("QuorumModule", "QuorumTest", data) == 0);
+    REQUIRE(secureDataStorage.getPendingRepairs() == 0);
+    REQUIRE(secureDataStorage.getFailedReplicaWrites() == 2);
+    secureDataStorage.deleteAllData();
+}
+#endif
+
 TEST_CASE("Delete Stored Data")
 {
     PISSD::SecureDataStorage secureDataStorage(&mutex);
@@ -323,6 +964,28 @@ TEST_CASE("Get Keys")
         REQUIRE(outputKeys.front() == "Key1");
         secureDataStorage.removeModule("Module1/Module1_1");
     }
+
+    SECTION("Key Cursor")
+    {
+        std::vector<std::string> outputPaths;
+        std::vector<std::string> outputKeys;
+        secureDataStorage.getAllKeys(outputPaths, outputKeys);
+
+        std::string module, key, resumeToken;
+        size_t count = 0;
+        {
+            PISSD::KeyCursor cursor(secureDataStorage, "", 3);
+            for (; count < 7 && cursor.next(module, key); count++);
+            resumeToken = cursor.getResumeToken();
+        }
+
+        PISSD::KeyCursor cursor(secureDataStorage, "", 3, resumeToken);
+        while (cursor.next(module, key))
+        {
+            count++;
+        }
+        REQUIRE(count == outputKeys.size());
+    }
 }
 
 TEST_CASE("Delete All Data")